@@ -24,6 +24,18 @@ if(CMAKE_BUILD_SPARSE)
   add_definitions(-DBUILD_SPARSE=1)
 endif()
 
+#input block and its multiplies in float, factors and solves in double.
+OPTION(CMAKE_BUILD_MIXED_PRECISION "Build Mixed Precision" OFF)
+if(CMAKE_BUILD_MIXED_PRECISION)
+  add_definitions(-DBUILD_MIXED_PRECISION=1)
+endif()
+
+#instruction set of the build host, enables the AVX2/AVX-512 batched NNLS.
+OPTION(CMAKE_BUILD_NATIVE "Build for the native instruction set" OFF)
+if(CMAKE_BUILD_NATIVE)
+  set(CMAKE_CXX_FLAGS "${CMAKE_CXX_FLAGS} -march=native")
+endif()
+
 OPTION(CMAKE_WITH_BARRIER_TIMING "Barrier placed to collect time" ON)
 if(CMAKE_WITH_BARRIER_TIMING)
   add_definitions(-D__WITH__BARRIER__TIMING__=1)
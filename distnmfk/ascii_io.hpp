@@ -0,0 +1,310 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file loads the per process text inputs with all the threads of the process.
+*/
+
+#ifndef DISTNMF_ASCII_IO_HPP_
+#define DISTNMF_ASCII_IO_HPP_
+
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <armadillo>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../planc-master/common/utils.h"
+
+namespace planc {
+
+/**
+ * Multi-threaded reader for the raw_ascii dense blocks and the
+ * "row col value" triplets of the sparse blocks. The file is memory mapped
+ * and split into one line aligned chunk per thread. A first pass counts
+ * the lines of every chunk so that the second pass knows the row each
+ * chunk starts at and parses straight into the destination matrix.
+ * Files with an armadillo header are left to armadillo: the loaders return
+ * false for them and for anything they cannot parse.
+ */
+class AsciiReader {
+ private:
+  const char *m_data;
+  size_t m_size;
+  int m_fd;
+  std::vector<size_t> m_begin;    /// first byte of every chunk
+  std::vector<UWORD> m_firstrow;  /// first line of every chunk
+
+  static bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == ',';
+  }
+
+  static const char *skipBlanks(const char *p, const char *end) {
+    while (p < end && isBlank(*p)) p++;
+    return p;
+  }
+
+  /**
+   * Parses one number starting at p. Decimal numbers with at most 19
+   * significant digits and a small exponent are exactly representable
+   * as mantissa * 10^e and are converted without strtod. Everything
+   * else, e.g. long mantissas, nan or inf, goes through strtod.
+   * @return the first character after the number, NULL on failure
+   */
+  static const char *parseDouble(const char *p, const char *end,
+                                 double *out) {
+    static const double kPow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                    1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                    1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *start = p;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+    uint64_t mant = 0;
+    int digits = 0, exp10 = 0;
+    bool any = false, truncated = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (digits < 19) {
+        mant = mant * 10 + (*p - '0');
+        if (mant) digits++;
+      } else {
+        truncated |= (*p != '0');
+        exp10++;
+      }
+      p++;
+      any = true;
+    }
+    if (p < end && *p == '.') {
+      p++;
+      while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+          mant = mant * 10 + (*p - '0');
+          if (mant) digits++;
+          exp10--;
+        } else {
+          truncated |= (*p != '0');
+        }
+        p++;
+        any = true;
+      }
+    }
+    if (any && p < end && (*p == 'e' || *p == 'E')) {
+      const char *q = p + 1;
+      bool eneg = false;
+      if (q < end && (*q == '-' || *q == '+')) eneg = (*q++ == '-');
+      int e = 0;
+      bool edigits = false;
+      while (q < end && *q >= '0' && *q <= '9') {
+        if (e < 100000) e = e * 10 + (*q - '0');
+        q++;
+        edigits = true;
+      }
+      if (edigits) {
+        exp10 += eneg ? -e : e;
+        p = q;
+      }
+    }
+    bool exact = any && !truncated && mant < (1ULL << 53) && exp10 >= -22 &&
+                 exp10 <= 22;
+    if (exact && (p == end || isBlank(*p) || *p == '\n')) {
+      double v = static_cast<double>(mant);
+      v = exp10 < 0 ? v / kPow10[-exp10] : v * kPow10[exp10];
+      *out = neg ? -v : v;
+      return p;
+    }
+    // slow path on a NUL terminated copy of the token
+    char token[128];
+    size_t len = 0;
+    p = start;
+    while (p < end && !isBlank(*p) && *p != '\n' && len < sizeof(token) - 1)
+      token[len++] = *p++;
+    token[len] = '\0';
+    char *stop;
+    *out = strtod(token, &stop);
+    if (len == 0 || stop != token + len) return NULL;
+    return p;
+  }
+
+  static const char *nextLine(const char *p, const char *end) {
+    const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+    return nl == NULL ? end : nl + 1;
+  }
+
+  static bool isEmptyLine(const char *p, const char *end) {
+    p = skipBlanks(p, end);
+    return p == end || *p == '\n';
+  }
+
+  /// line aligned chunks and the number of non empty lines before each
+  UWORD splitLines() {
+    int nthreads = omp_get_max_threads();
+    size_t minchunk = 1 << 16;
+    if (static_cast<size_t>(nthreads) * minchunk > m_size)
+      nthreads = std::max<size_t>(1, m_size / minchunk);
+    m_begin.assign(nthreads + 1, m_size);
+    m_begin[0] = 0;
+    for (int t = 1; t < nthreads; t++) {
+      size_t b = (m_size / nthreads) * t;
+      const char *p = nextLine(m_data + b - 1, m_data + m_size);
+      m_begin[t] = p - m_data;
+    }
+    for (int t = nthreads - 1; t > 0; t--)
+      if (m_begin[t] > m_begin[t + 1]) m_begin[t] = m_begin[t + 1];
+    std::vector<UWORD> lines(nthreads, 0);
+#pragma omp parallel for num_threads(nthreads)
+    for (int t = 0; t < nthreads; t++) {
+      const char *p = m_data + m_begin[t], *end = m_data + m_begin[t + 1];
+      UWORD count = 0;
+      while (p < end) {
+        const char *q = nextLine(p, end);
+        if (!isEmptyLine(p, q)) count++;
+        p = q;
+      }
+      lines[t] = count;
+    }
+    m_firstrow.assign(nthreads + 1, 0);
+    for (int t = 0; t < nthreads; t++)
+      m_firstrow[t + 1] = m_firstrow[t] + lines[t];
+    return m_firstrow[nthreads];
+  }
+
+  int numChunks() const { return static_cast<int>(m_begin.size()) - 1; }
+
+  /// number of values on the first non empty line
+  UWORD countColumns() const {
+    const char *p = m_data, *end = m_data + m_size;
+    while (p < end) {
+      const char *q = nextLine(p, end);
+      if (!isEmptyLine(p, q)) {
+        UWORD cols = 0;
+        p = skipBlanks(p, q);
+        while (p < q && *p != '\n') {
+          while (p < q && !isBlank(*p) && *p != '\n') p++;
+          cols++;
+          p = skipBlanks(p, q);
+        }
+        return cols;
+      }
+      p = q;
+    }
+    return 0;
+  }
+
+ public:
+  explicit AsciiReader(const std::string &file_name)
+      : m_data(NULL), m_size(0), m_fd(-1) {
+    m_fd = open(file_name.c_str(), O_RDONLY);
+    if (m_fd < 0) return;
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size == 0) return;
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    if (map == MAP_FAILED) return;
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+    m_data = static_cast<const char *>(map);
+    m_size = st.st_size;
+  }
+
+  ~AsciiReader() {
+    if (m_data != NULL) munmap(const_cast<char *>(m_data), m_size);
+    if (m_fd >= 0) close(m_fd);
+  }
+
+  /// false for unreadable files and files with an armadillo header
+  bool good() const {
+    return m_data != NULL &&
+           !(m_size >= 8 && strncmp(m_data, "ARMA_", 5) == 0);
+  }
+
+  /**
+   * Loads a dense raw_ascii matrix, one row per line.
+   * @param[out] X resized to the number of lines x values per line
+   * @return false if the file is not a well formed raw_ascii matrix
+   */
+  template <typename eT>
+  bool loadRawAscii(arma::Mat<eT> *X) {
+    if (!good()) return false;
+    UWORD cols = countColumns();
+    UWORD rows = splitLines();
+    X->set_size(rows, cols);
+    eT *mem = X->memptr();
+    int failed = 0;
+#pragma omp parallel for num_threads(numChunks()) reduction(+ : failed)
+    for (int t = 0; t < numChunks(); t++) {
+      const char *p = m_data + m_begin[t], *end = m_data + m_begin[t + 1];
+      UWORD r = m_firstrow[t];
+      while (p < end && !failed) {
+        const char *q = nextLine(p, end);
+        if (!isEmptyLine(p, q)) {
+          const char *s = p;
+          for (UWORD c = 0; c < cols; c++) {
+            double v;
+            s = skipBlanks(s, q);
+            s = (s < q && *s != '\n') ? parseDouble(s, q, &v) : NULL;
+            if (s == NULL) {
+              failed++;
+              break;
+            }
+            mem[c * rows + r] = static_cast<eT>(v);
+          }
+          if (s != NULL && !isEmptyLine(s, q)) failed++;
+          r++;
+        }
+        p = q;
+      }
+    }
+    return failed == 0;
+  }
+
+  /**
+   * Loads "row col value" triplets with zero based indices.
+   * @param[out] locations 2 x nnz matrix of row and column indices
+   * @param[out] values nnz values
+   * @return false if a line does not hold three numbers
+   */
+  template <typename eT>
+  bool loadTriplets(arma::umat *locations, arma::Col<eT> *values) {
+    if (!good()) return false;
+    UWORD nnz = splitLines();
+    locations->set_size(2, nnz);
+    values->set_size(nnz);
+    UWORD *loc = locations->memptr();
+    eT *val = values->memptr();
+    int failed = 0;
+#pragma omp parallel for num_threads(numChunks()) reduction(+ : failed)
+    for (int t = 0; t < numChunks(); t++) {
+      const char *p = m_data + m_begin[t], *end = m_data + m_begin[t + 1];
+      UWORD e = m_firstrow[t];
+      while (p < end && !failed) {
+        const char *q = nextLine(p, end);
+        if (!isEmptyLine(p, q)) {
+          double ijv[3];
+          const char *s = p;
+          for (int c = 0; c < 3 && s != NULL; c++) {
+            s = skipBlanks(s, q);
+            s = (s < q && *s != '\n') ? parseDouble(s, q, &ijv[c]) : NULL;
+          }
+          if (s == NULL || ijv[0] < 0 || ijv[1] < 0) {
+            failed++;
+            break;
+          }
+          loc[2 * e] = static_cast<UWORD>(ijv[0]);
+          loc[2 * e + 1] = static_cast<UWORD>(ijv[1]);
+          val[e] = static_cast<eT>(ijv[2]);
+          e++;
+        }
+        p = q;
+      }
+    }
+    return failed == 0;
+  }
+};
+
+}  // namespace planc
+
+#endif  // DISTNMF_ASCII_IO_HPP_
@@ -6,22 +6,20 @@ This file is modified from distanlsbpp.hpp file of Ramakrishnan Kannan's Planc l
 */
 #ifndef DISTNMF_DISTANLSBPP_HPP_
 #define DISTNMF_DISTANLSBPP_HPP_
+#include <omp.h>
+#include <algorithm>
 #include <string>
+#include <vector>
 #include "../planc-master/distnmf/aunmf.hpp"
 #include "nnls_bpp.hpp"
+#include "nnls_bpp_small.hpp"
+#include "nnls_batch.hpp"
 
 /**
  * Provides the updateW and updateH for the
  * distributed ANLS/BPP algorithm.
  */
 
-#ifdef BUILD_CUDA
-#define ONE_THREAD_MATRIX_SIZE 1000
-#include <omp.h>
-#else
-#define ONE_THREAD_MATRIX_SIZE giventInput.n_cols + 5
-#endif
-
 namespace planc {
 
 template <class INPUTMATTYPE>
@@ -29,61 +27,117 @@ class DistANLSBPP : public DistAUNMF<INPUTMATTYPE> {
  private:
   ROWVEC localWnorm;
   ROWVEC Wnorm;
+  std::vector<BPPNNLS<MAT, VEC> > m_solvers;  /// one per thread, reused
+  // k x rows passive sets of the last solve for W and H. Between outer
+  // iterations they barely change, so the next solve starts from them.
+  arma::umat m_passiveW, m_passiveH;
 
   void allocateMatrices() {}
 
   /**
-   * Multi threaded ANLS/BPP using openMP
+   * Columns per chunk of the threaded solve. The right hand sides, the
+   * solution and the gradient of a chunk, 3k values per column, fit in
+   * about 256KB, the L2 share of a core. With fewer columns than that
+   * the columns are spread evenly over the threads.
    */
-  void updateOtherGivenOneMultipleRHS(const MAT& giventGiven,
-                                      const MAT& giventInput, MAT* othermat) {
-    UINT numThreads = (giventInput.n_cols / ONE_THREAD_MATRIX_SIZE) + 1;
-#pragma omp parallel for schedule(dynamic)
-    for (UINT i = 0; i < numThreads; i++) {
-      UINT spanStart = i * ONE_THREAD_MATRIX_SIZE;
-      UINT spanEnd = (i + 1) * ONE_THREAD_MATRIX_SIZE - 1;
-      if (spanEnd > giventInput.n_cols - 1) {
-        spanEnd = giventInput.n_cols - 1;
+  static UWORD chunkColumns(UWORD k, UWORD cols, int nthreads) {
+    const UWORD kChunkBytes = 1 << 18;
+    UWORD cachecols = std::max<UWORD>(1, kChunkBytes / (3 * sizeof(double) * k));
+    UWORD perthread = (cols + nthreads - 1) / nthreads;
+    return std::max<UWORD>(1, std::min(cachecols, perthread));
+  }
+
+  /**
+   * Solves the columns first, ..., last with the kernels specialized on k,
+   * BPP_BATCH_LANES columns at a time if batch is given and one by one
+   * otherwise. A column the batch leaves open goes to the per row kernel,
+   * and a column that one gives up on is solved again by the general
+   * solver, each time from the same passive set.
+   */
+  static void solveSmall(SmallBPPKernel kernel, BatchBPPKernel batch,
+                         const MAT& giventGiven, const MAT& giventInput,
+                         UWORD first, UWORD last, MAT* othermat,
+                         arma::umat* passive,
+                         BPPNNLS<MAT, VEC>* subProblem) {
+    UWORD k = giventGiven.n_rows;
+    double x[BPP_SMALL_MAX_K];
+    unsigned done = 0;
+    for (UWORD c = first; c <= last; c++) {
+      UWORD lane = (c - first) % BPP_BATCH_LANES;
+      if (batch != NULL && lane == 0) {
+        int count = std::min<UWORD>(BPP_BATCH_LANES, last - c + 1);
+        done = batch(giventGiven.memptr(), giventInput.colptr(c), count,
+                     othermat->memptr() + c, othermat->n_rows,
+                     passive->colptr(c));
       }
-      // if it is exactly divisible, the last iteration is unnecessary.
-      BPPNNLS<MAT, VEC>* subProblem;
-      if (spanStart <= spanEnd) {
-        if (spanStart == spanEnd) {
-          subProblem = new BPPNNLS<MAT, VEC>(
-              giventGiven, (VEC)giventInput.col(spanStart), true);
-        } else {  // if (spanStart < spanEnd)
-          subProblem = new BPPNNLS<MAT, VEC>(
-              giventGiven, (MAT)giventInput.cols(spanStart, spanEnd), true);
-        }
-#ifdef MPI_VERBOSE
-#pragma omp parallel
-        {
-          DISTPRINTINFO("Scheduling " << worh << " start=" << spanStart
-                                      << ", end=" << spanEnd
-                                      << ", tid=" << omp_get_thread_num());
-        }
+      if ((done >> lane) & 1) continue;
+      if (kernel(giventGiven.memptr(), giventInput.colptr(c), x,
+                 passive->colptr(c))) {
+        for (UWORD i = 0; i < k; i++) (*othermat)(c, i) = x[i];
+      } else {
+        const MAT rhs(const_cast<double*>(giventInput.colptr(c)), k, 1,
+                      false, true);
+        arma::umat mask(passive->colptr(c), k, 1, false, true);
+        subProblem->solveNNLS(giventGiven, rhs, &mask);
+        subProblem->solutionToRows(c, othermat);
+      }
+    }
+  }
+
+  /**
+   * Multi threaded ANLS/BPP using openMP. The columns of giventInput are
+   * split into chunks that the threads solve with their own reused
+   * solver, reading giventGiven and the chunk in place and writing the
+   * solution straight into the rows of othermat. For k up to
+   * BPP_SMALL_MAX_K the chunks go through the kernels specialized on k,
+   * batched over the SIMD lanes in builds with BPP_BATCH_SIMD.
+   * @param[in,out] passive passive sets the columns start from, replaced
+   *                by the ones of the solution
+   */
+  void updateOtherGivenOneMultipleRHS(const MAT& giventGiven,
+                                      const MAT& giventInput, MAT* othermat,
+                                      arma::umat* passive) {
+    UWORD cols = giventInput.n_cols;
+    if (cols == 0) return;
+    int numThreads = omp_get_max_threads();
+    UWORD chunk = chunkColumns(giventInput.n_rows, cols, numThreads);
+    UWORD numChunks = (cols + chunk - 1) / chunk;
+    if (numChunks < static_cast<UWORD>(numThreads)) numThreads = numChunks;
+    if (m_solvers.size() < static_cast<size_t>(numThreads))
+      m_solvers.resize(numThreads);
+    SmallBPPKernel kernel = smallBPPKernel(giventGiven.n_rows);
+#ifdef BPP_BATCH_SIMD
+    BatchBPPKernel batch = batchBPPKernel(giventGiven.n_rows);
+#else
+    BatchBPPKernel batch = NULL;
 #endif
-        subProblem->solveNNLS();
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+    for (UWORD i = 0; i < numChunks; i++) {
+      UWORD spanStart = i * chunk;
+      UWORD spanEnd = std::min(cols, spanStart + chunk) - 1;
+      BPPNNLS<MAT, VEC>& subProblem = m_solvers[omp_get_thread_num()];
+      if (kernel != NULL) {
+        solveSmall(kernel, batch, giventGiven, giventInput, spanStart,
+                   spanEnd, othermat, passive, &subProblem);
+        continue;
+      }
+      const MAT rhs(const_cast<double*>(giventInput.colptr(spanStart)),
+                    giventInput.n_rows, spanEnd - spanStart + 1, false, true);
+      arma::umat mask(passive->colptr(spanStart), passive->n_rows,
+                      spanEnd - spanStart + 1, false, true);
+      subProblem.solveNNLS(giventGiven, rhs, &mask);
 #ifdef MPI_VERBOSE
-#pragma omp parallel
-        {
-          DISTPRINTINFO("completed " << worh << " start=" << spanStart
-                                     << ", end=" << spanEnd
-                                     << ", tid=" << omp_get_thread_num()
-                                     << " cpu=" << sched_getcpu());
-        }
+      DISTPRINTINFO("completed start=" << spanStart << ", end=" << spanEnd
+                                       << ", tid=" << omp_get_thread_num());
 #endif
-        if (spanStart == spanEnd) {
-          ROWVEC solVec = subProblem->getSolutionVector().t();
-          (*othermat).row(i) = solVec;
-        } else {  // if (spanStart < spanEnd)
-          (*othermat).rows(spanStart, spanEnd) =
-              subProblem->getSolutionMatrix().t();
-        }
-        subProblem->clear();
-        delete subProblem;
-      }
+      subProblem.solutionToRows(spanStart, othermat);
+    }
+    UWORD fallbacks = 0;
+    for (size_t i = 0; i < m_solvers.size(); i++) {
+      fallbacks += m_solvers[i].fallbacks();
+      m_solvers[i].clearFallbacks();
     }
+    this->time_stats.nnls_fallbacks(fallbacks);
   }
 
  protected:
@@ -94,7 +148,8 @@ class DistANLSBPP : public DistAUNMF<INPUTMATTYPE> {
    * this->HtH is of size kxk
   */
   void updateW() {
-    updateOtherGivenOneMultipleRHS(this->HtH, this->AHtij, &this->W);
+    updateOtherGivenOneMultipleRHS(this->HtH, this->AHtij, &this->W,
+                                   &m_passiveW);
     this->Wt = this->W.t();
   }
   /**
@@ -104,7 +159,8 @@ class DistANLSBPP : public DistAUNMF<INPUTMATTYPE> {
    * this->WtW is of size kxk
    */  
   void updateH() {
-    updateOtherGivenOneMultipleRHS(this->WtW, this->WtAij, &this->H);
+    updateOtherGivenOneMultipleRHS(this->WtW, this->WtAij, &this->H,
+                                   &m_passiveH);
     this->Ht = this->H.t();
   }
 
@@ -116,6 +172,8 @@ class DistANLSBPP : public DistAUNMF<INPUTMATTYPE> {
                                 communicator, numkblks, relerr_dir) {
     localWnorm.zeros(this->k);
     Wnorm.zeros(this->k);
+    m_passiveW.zeros(this->k, this->W.n_rows);
+    m_passiveH.zeros(this->k, this->H.n_rows);
     PRINTROOT("DistANLSBPP() constructor successful");
   }
 
@@ -12,9 +12,15 @@ This file is modified from distio.hpp file of Ramakrishnan Kannan's Planc librar
 
 #include <unistd.h>
 #include <armadillo>
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <random>
 #include <string>
+#include <vector>
 #include "../planc-master/common/distutils.hpp"
 #include "../planc-master/distnmf/mpicomm.hpp"
+#include "ascii_io.hpp"
 
 /**
  * File name formats
@@ -49,6 +55,10 @@ class DistIO {
 #endif
 
   const iodistributions m_distio;
+  // parameters of the planted rank generator, see plantedLowRank
+  double m_noise;
+  double m_colskew;
+  static const UWORD kTileRows = 4096;
   /**
    * A random matrix is always needed for sparse case
    * to get the pattern. That is., the indices where
@@ -127,22 +137,64 @@ class DistIO {
         }
         break;
       case TWOD:
+        // a column of A is split across the processor column
         if (i_normtype == L2NORM) {
           normc = arma::sum(arma::square(m_A));
           MPI_Allreduce(normc.memptr(), globalnormA.memptr(), m_A.n_cols,
-                        MPI_DOUBLE, MPI_SUM, this->m_mpicomm.commSubs()[1]);
+                        MPI_DOUBLE, MPI_SUM, this->m_mpicomm.commSubs()[0]);
         } else if (i_normtype == MAXNORM) {
           normc = arma::max(m_A);
           MPI_Allreduce(normc.memptr(), globalnormA.memptr(), m_A.n_cols,
-                        MPI_DOUBLE, MPI_SUM, this->m_mpicomm.commSubs()[1]);
+                        MPI_DOUBLE, MPI_MAX, this->m_mpicomm.commSubs()[0]);
         }
         break;
       default:
         INFO << "cannot normalize" << std::endl;
     }
+    if (i_normtype == L2NORM) globalnormA = arma::sqrt(globalnormA);
+    globalnormA.elem(arma::find(globalnormA == 0)).ones();
     normmat = arma::repmat(globalnormA, m_A.n_rows, 1);
     m_A /= normmat;
   }
+#else
+  /**
+   * Column normalization of a sparse block. The L2 or max norm of every
+   * local column is computed over the stored nonzeros only, reduced
+   * across the processes sharing the column and applied to the values in
+   * place. Only the row distributions of A are supported.
+   */
+  void normalize(normtype i_normtype) {
+    MPI_Comm comm;
+    if (m_distio == TWOD) {
+      comm = this->m_mpicomm.commSubs()[0];
+    } else if (m_distio == ONED_ROW) {
+      comm = MPI_COMM_WORLD;
+    } else {
+      INFO << "cannot normalize" << std::endl;
+      return;
+    }
+    ROWVEC normc = arma::zeros<ROWVEC>(m_A.n_cols);
+    ROWVEC globalnormA = arma::zeros<ROWVEC>(m_A.n_cols);
+    double* values = arma::access::rwp(m_A.values);
+    for (UWORD j = 0; j < m_A.n_cols; j++) {
+      for (UWORD i = m_A.col_ptrs[j]; i < m_A.col_ptrs[j + 1]; i++) {
+        if (i_normtype == L2NORM) {
+          normc(j) += values[i] * values[i];
+        } else if (std::abs(values[i]) > normc(j)) {
+          normc(j) = std::abs(values[i]);
+        }
+      }
+    }
+    MPI_Allreduce(normc.memptr(), globalnormA.memptr(), m_A.n_cols,
+                  MPI_DOUBLE, i_normtype == L2NORM ? MPI_SUM : MPI_MAX, comm);
+    if (i_normtype == L2NORM) globalnormA = arma::sqrt(globalnormA);
+    for (UWORD j = 0; j < m_A.n_cols; j++) {
+      if (globalnormA(j) == 0) continue;
+      for (UWORD i = m_A.col_ptrs[j]; i < m_A.col_ptrs[j + 1]; i++) {
+        values[i] /= globalnormA(j);
+      }
+    }
+  }
 #endif
 
   /**
@@ -224,6 +276,201 @@ class DistIO {
 #endif
   }
 
+  /**
+   * Position of the rank's H block in the global H. Ranks that share a
+   * processor column are consecutive, i.e. H_0, H_pc, H_2pc, .., H_1, ..
+   */
+  int gridOrder(int rank) const {
+    if (m_distio != TWOD) return rank;
+    int pr = m_mpicomm.pr(), pc = m_mpicomm.pc();
+    return (rank % pc) * pr + rank / pc;
+  }
+
+  static std::string baseName(const std::string& path) {
+    size_t pos = path.find_last_of('/');
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+  }
+
+  /**
+   * Writes the local rows of a factor as row major doubles starting at
+   * global row rowoffset of a globalrows x k file.
+   */
+  void writeBinaryFactor(const MAT& X, UWORD rowoffset, UWORD globalrows,
+                         const std::string& file_name) {
+    MAT Xt = X.t();
+    MPI_File fh;
+    int rc = MPI_File_open(MPI_COMM_WORLD, file_name.c_str(),
+                           MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL,
+                           &fh);
+    if (rc != MPI_SUCCESS) {
+      ERR << MPI_RANK << "::cannot open " << file_name << std::endl;
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_File_set_size(fh, globalrows * X.n_cols * sizeof(double));
+    MPI_Offset offset = rowoffset * X.n_cols * sizeof(double);
+    MPI_File_write_at_all(fh, offset, Xt.memptr(), Xt.n_elem, MPI_DOUBLE,
+                          MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+  }
+
+  /**
+   * Counter based random numbers. The value only depends on the global
+   * indices and the stream, so every process can generate its own rows
+   * and columns without generating or communicating the rest.
+   */
+  static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+  }
+
+  static double hashUniform(uint64_t i, uint64_t j, uint64_t stream) {
+    uint64_t h = mix64(mix64(mix64(stream) ^ i) ^ j);
+    return ((h >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+  }
+
+  static double hashNormal(uint64_t i, uint64_t j, uint64_t stream) {
+    double u1 = hashUniform(i, j, 2 * stream);
+    double u2 = hashUniform(i, j, 2 * stream + 1);
+    return sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+  }
+
+  enum plantedstreams { kStreamW = 11, kStreamH, kStreamSkew, kStreamNoise,
+                        kStreamMask };
+
+  /// planted left factor for global rows r0..r0+rows-1
+  static MAT plantedW(UWORD r0, UWORD rows, UWORD k) {
+    MAT W(rows, k);
+    for (UWORD c = 0; c < k; c++)
+      for (UWORD i = 0; i < rows; i++)
+        W(i, c) = hashUniform(r0 + i, c, kStreamW);
+    return W;
+  }
+
+  /// planted right factor for global columns c0..c0+cols-1 as k x cols
+  MAT plantedHt(UWORD c0, UWORD cols, UWORD k) const {
+    MAT Ht(k, cols);
+    for (UWORD j = 0; j < cols; j++) {
+      double scale = 1.0;
+      if (m_colskew > 0)
+        scale = exp(m_colskew * hashNormal(c0 + j, 0, kStreamSkew));
+      for (UWORD c = 0; c < k; c++)
+        Ht(c, j) = scale * hashUniform(c0 + j, c, kStreamH);
+    }
+    return Ht;
+  }
+
+  /**
+   * Calls f(i, j) in column major order for the nonzeros of the planted
+   * pattern inside the global block rows r0..r1-1, columns c0..c1-1.
+   * Rows are split in fixed tiles and every (column, tile) pair draws
+   * geometric gaps from its own stream. The pattern is therefore the same
+   * for any processor grid and costs O(nnz) instead of O(rows x cols).
+   */
+  template <class FUNC>
+  static void plantedPattern(UWORD r0, UWORD r1, UWORD c0, UWORD c1,
+                             double density, FUNC f) {
+    bool full = density <= 0 || density >= 1;
+    double logq = full ? 0 : log(1.0 - density);
+    for (UWORD j = c0; j < c1; j++) {
+      if (full) {
+        for (UWORD i = r0; i < r1; i++) f(i - r0, j - c0);
+        continue;
+      }
+      for (UWORD t = r0 / kTileRows; t * kTileRows < r1; t++) {
+        UWORD i = t * kTileRows;
+        UWORD tend = std::min((t + 1) * kTileRows, r1);
+        for (uint64_t draw = 0;; draw++) {
+          double u = hashUniform(j, (t << 32) | draw, kStreamMask);
+          double gap = floor(log(u) / logq);
+          if (gap >= static_cast<double>(tend - i)) break;
+          i += static_cast<UWORD>(gap);
+          if (i >= r0) f(i - r0, j - c0);
+          i++;
+        }
+      }
+    }
+  }
+
+  /**
+   * Planted rank k block of the global m x n matrix W_true H_true^T with
+   * uniform factors. Column j of H_true is scaled by exp(colskew g_j) with
+   * g_j standard normal to skew the column norms, every entry gets a
+   * relative gaussian noise of m_noise and is clamped to be nonnegative,
+   * and only a fraction density of the entries is kept.
+   * @param[in] r0 first global row of the block
+   * @param[in] c0 first global column of the block
+   * @param[in] k planted rank
+   * @param[in] density fraction of nonzeros. >= 1 for a dense block
+   * @param[out] X the block. Its size must already be set
+   */
+  void plantedLowRank(UWORD r0, UWORD c0, UWORD k, double density,
+                      MATTYPE* X) {
+    UWORD rows = (*X).n_rows, cols = (*X).n_cols;
+    MAT W = plantedW(r0, rows, k);
+    MAT Ht = plantedHt(c0, cols, k);
+    double noise = m_noise;
+#ifdef BUILD_SPARSE
+    std::vector<UWORD> ri, ci;
+    std::vector<double> vi;
+    plantedPattern(r0, r0 + rows, c0, c0 + cols, density,
+                   [&](UWORD i, UWORD j) {
+                     ri.push_back(i);
+                     ci.push_back(j);
+                   });
+    arma::umat locs(2, ri.size());
+    VEC vals(ri.size());
+    for (UWORD e = 0; e < ri.size(); e++) {
+      double v = arma::dot(W.row(ri[e]), Ht.col(ci[e]));
+      if (noise > 0)
+        v *= 1 + noise * hashNormal(r0 + ri[e], c0 + ci[e], kStreamNoise);
+      locs(0, e) = ri[e];
+      locs(1, e) = ci[e];
+      vals(e) = v > 0 ? v : 0;
+    }
+    (*X) = SP_MAT(locs, vals, rows, cols, false, true);
+#else
+    MAT WH = W * Ht;
+    (*X).zeros(rows, cols);
+    plantedPattern(r0, r0 + rows, c0, c0 + cols, density,
+                   [&](UWORD i, UWORD j) {
+                     double v = WH(i, j);
+                     if (noise > 0)
+                       v *= 1 + noise * hashNormal(r0 + i, c0 + j,
+                                                   kStreamNoise);
+                     (*X)(i, j) = v > 0 ? v : 0;
+                   });
+#endif
+  }
+
+  /// Generates the local blocks of rand_planted for the distribution.
+  void readPlanted(UWORD m, UWORD n, UWORD k, double sparsity, UWORD pr,
+                   UWORD pc) {
+    int p = MPI_SIZE;
+    switch (m_distio) {
+      case ONED_ROW:
+        m_Arows.set_size(m / p, n);
+        plantedLowRank(MPI_RANK * (m / p), 0, k, sparsity, &m_Arows);
+        break;
+      case ONED_COL:
+        m_Acols.set_size(m, n / p);
+        plantedLowRank(0, MPI_RANK * (n / p), k, sparsity, &m_Acols);
+        break;
+      case ONED_DOUBLE:
+        m_Arows.set_size(m / p, n);
+        plantedLowRank(MPI_RANK * (m / p), 0, k, sparsity, &m_Arows);
+        m_Acols.set_size(m, n / p);
+        plantedLowRank(0, MPI_RANK * (n / p), k, sparsity, &m_Acols);
+        break;
+      case TWOD:
+        m_A.set_size(m / pr, n / pc);
+        plantedLowRank(MPI_ROW_RANK * (m / pr), MPI_COL_RANK * (n / pc), k,
+                       sparsity, &m_A);
+        break;
+    }
+  }
+
 #ifdef BUILD_SPARSE
   void uniform_dist_matrix(MATTYPE& A) {
     // make the matrix of ONED distribution
@@ -317,7 +564,34 @@ class DistIO {
 
  public:
   DistIO<MATTYPE>(const MPICommunicator& mpic, const iodistributions& iod)
-      : m_mpicomm(mpic), m_distio(iod) {}
+      : m_mpicomm(mpic), m_distio(iod), m_noise(0), m_colskew(0) {}
+
+  /**
+   * Parameters of the rand_planted input.
+   * @param[in] noise standard deviation of the relative gaussian noise
+   * @param[in] colskew standard deviation of the log column scales of A
+   */
+  void plantedParams(double noise, double colskew) {
+    this->m_noise = noise;
+    this->m_colskew = colskew;
+  }
+
+  /**
+   * Writes the ground truth factors of rand_planted with the layout of
+   * writeOutputBinary. Every process generates only the rows of W_true and
+   * H_true it would own as an NMF factor.
+   * @param[in] m - globalm
+   * @param[in] n - globaln
+   * @param[in] k - planted rank
+   * @param[in] output file name prefix
+   */
+  void writePlantedTruth(UWORD m, UWORD n, int k,
+                         const std::string& output_file_name) {
+    UWORD ownedm = m / MPI_SIZE, ownedn = n / MPI_SIZE;
+    MAT W = plantedW(MPI_RANK * ownedm, ownedm, k);
+    MAT H = plantedHt(gridOrder(MPI_RANK) * ownedn, ownedn, k).t();
+    writeOutputBinary(W, H, -1, k, output_file_name);
+  }
   /**
    * We need m,n,pr,pc only for rand matrices. If otherwise we are
    * expecting the file will hold all the details.
@@ -325,6 +599,7 @@ class DistIO {
    * If the filename is rand_lowrank/rand_uniform, appropriate
    * random functions will be called. Otherwise, it will be loaded from file.
    * @param[in] file_name. For random matrices rand_lowrank/rand_uniform
+   *                       or rand_planted, see plantedLowRank.
    * @param[in] m - globalm. Needed only for random matrices. 
    *                otherwise, we will know from file.
    * @param[in] n - globaln. Needed only for random matrices
@@ -342,7 +617,9 @@ class DistIO {
     //     << "::" << this->MPI_RANK << "::" << this->m_mpicomm.size() <<
     //     std::endl;
     std::string rand_prefix("rand_");
-    if (!file_name.compare(0, rand_prefix.size(), rand_prefix)) {
+    if (file_name == "rand_planted") {
+      readPlanted(m, n, k, sparsity, pr, pc);
+    } else if (!file_name.compare(0, rand_prefix.size(), rand_prefix)) {
       std::string type = file_name.substr(rand_prefix.size());
       assert(type == "normal" || type == "lowrank" || type == "uniform");
       switch (m_distio) {
@@ -390,7 +667,9 @@ class DistIO {
         m_Arows.load(sr.str(), arma::coord_ascii);
         uniform_dist_matrix(m_Arows);
 #else
-        m_Arows.load(sr.str()); 
+        if (!AsciiReader(sr.str()).loadRawAscii(&m_Arows)) {
+          m_Arows.load(sr.str());
+        }
 #endif
       }
       if (m_distio == ONED_COL || m_distio == ONED_DOUBLE) {
@@ -399,7 +678,9 @@ class DistIO {
         m_Acols.load(sc.str(), arma::coord_ascii);
         uniform_dist_matrix(m_Acols);
 #else
-        m_Acols.load(sc.str());
+        if (!AsciiReader(sc.str()).loadRawAscii(&m_Acols)) {
+          m_Acols.load(sc.str());
+        }
 #endif
         m_Acols = m_Acols.t();
       }
@@ -407,14 +688,19 @@ class DistIO {
         // sr << file_name << "_" << MPI_SIZE << "_" << MPI_RANK;
         sr << file_name << MPI_RANK;
 #ifdef BUILD_SPARSE
-        MAT temp_ijv;
-        temp_ijv.load(sr.str(), arma::raw_ascii);
-        if (temp_ijv.n_rows > 0 && temp_ijv.n_cols > 0) {
-          MAT vals(2, temp_ijv.n_rows);
-          MAT idxs_only = temp_ijv.cols(0, 1);
-          arma::umat idxs = arma::conv_to<arma::umat>::from(idxs_only);
-          arma::umat idxst = idxs.t();
-          vals = temp_ijv.col(2);
+        arma::umat idxst;
+        VEC vals;
+        if (!AsciiReader(sr.str()).loadTriplets(&idxst, &vals)) {
+          MAT temp_ijv;
+          temp_ijv.load(sr.str(), arma::raw_ascii);
+          if (temp_ijv.n_rows > 0 && temp_ijv.n_cols > 0) {
+            MAT idxs_only = temp_ijv.cols(0, 1);
+            arma::umat idxs = arma::conv_to<arma::umat>::from(idxs_only);
+            idxst = idxs.t();
+            vals = temp_ijv.col(2);
+          }
+        }
+        if (vals.n_elem > 0) {
           SP_MAT temp_spmat(idxst, vals);
           m_A = temp_spmat;
         } else {
@@ -426,15 +712,15 @@ class DistIO {
         // m_A.load(sr.str(), arma::coord_ascii);
         uniform_dist_matrix(m_A);
 #else
-        m_A.load(sr.str());
+        if (!AsciiReader(sr.str()).loadRawAscii(&m_A)) {
+          m_A.load(sr.str());
+        }
 #endif
       }
     }
-#ifndef BUILD_SPARSE
     if (i_normalization != NONE) {
       normalize(i_normalization);
     }
-#endif
   }
 
   /**
@@ -452,26 +738,18 @@ class DistIO {
     DISTPRINTINFO("randAtimesBeta::" << primeseedidx);
 #endif
 #ifdef BUILD_SPARSE
-    if (type == "uniform" || type == "lowrank") {
-      (*X).sprandu((*X).n_rows, (*X).n_cols, sparsity);
+    // only the stored nonzeros of b carry a perturbation
+    VEC beta(b->n_nonzero);
+    if (type == "uniform") {
+      beta.randu();
     } else if (type == "normal") {
-      (*X).sprandn((*X).n_rows, (*X).n_cols, sparsity);
+      beta.randn();
     }
-    SP_MAT::iterator start_it = (*X).begin();
-    SP_MAT::iterator end_it = (*X).end();
-    for (SP_MAT::iterator it = start_it; it != end_it; ++it) {
-      double currentValue = (*it);
-      (*it) = ceil(kalpha * currentValue + kbeta);
-      if ((*it) < 0) (*it) = kbeta;
+    double lb = -0.001, ub = 0.001;
+    double* values = arma::access::rwp(b->values);
+    for (UWORD i = 0; i < b->n_nonzero; i++) {
+      values[i] = (ub - lb) * beta(i) + lb + 1;
     }
-    // for (uint i=0; i<(*X).n_nonzero;i++){
-    //     double currentValue = (*X).values[i];
-    //     currentValue *= kalpha;
-    //     currentValue += kbeta;
-    //     currentValue = ceil(currentValue);
-    //     if (currentValue <= 0) currentValue=kbeta;
-    //     (*X).values[i]=currentValue;
-    // }
 #else
     if (type == "uniform") {
       (*b).randu();
@@ -485,6 +763,56 @@ class DistIO {
 #endif
   }
 
+#ifdef BUILD_SPARSE
+  /**
+   * Sparse counterpart of A % randBetaMatrix. The stored nonzeros of X,
+   * which must have the pattern of A, are overwritten in place with the
+   * values of A times 1 + U(-0.001, 0.001), so a run does not allocate and
+   * never touches the implicit zeros.
+   * @param[in] A unperturbed input block
+   * @param[in] primeseedidx seed index of the perturbation
+   * @param[out] X perturbed block with the pattern of A, double or float
+   * @return squared frobenius norm of X
+   */
+  template <class eT>
+  double perturbNonzeros(const SP_MAT& A, const int primeseedidx,
+                         arma::SpMat<eT>* X) {
+    assert(X->n_nonzero == A.n_nonzero);
+    std::mt19937_64 gen(random_sieve(primeseedidx));
+    std::uniform_real_distribution<double> beta(-0.001, 0.001);
+    eT* values = arma::access::rwp(X->values);
+    double sqnorm = 0;
+    for (UWORD i = 0; i < A.n_nonzero; i++) {
+      values[i] = static_cast<eT>(A.values[i] * (1 + beta(gen)));
+      sqnorm += static_cast<double>(values[i]) * values[i];
+    }
+    return sqnorm;
+  }
+#else
+  /**
+   * X = A % beta for the beta of randBetaMatrix in one pass, which also
+   * yields the norm of X without sweeping over it again.
+   * @param[in] A unperturbed input block
+   * @param[in] beta perturbation of the size of A
+   * @param[out] X perturbed block of the size of A, double or float
+   * @return squared frobenius norm of X
+   */
+  template <class eT>
+  double perturbDense(const MAT& A, const MAT& beta, arma::Mat<eT>* X) {
+    assert(X->n_elem == A.n_elem && beta.n_elem == A.n_elem);
+    const double* a = A.memptr();
+    const double* b = beta.memptr();
+    eT* x = X->memptr();
+    double sqnorm = 0;
+#pragma omp parallel for reduction(+ : sqnorm)
+    for (UWORD i = 0; i < A.n_elem; i++) {
+      x[i] = static_cast<eT>(a[i] * b[i]);
+      sqnorm += static_cast<double>(x[i]) * x[i];
+    }
+    return sqnorm;
+  }
+#endif
+
   /**
    * Writes the factor matrix as output_file_name_W_MPISIZE_MPIRANK
    * @param[in] Local W factor matrix
@@ -509,6 +837,60 @@ class DistIO {
     H.save(sh.str(), arma::raw_ascii);
   }
 
+  /**
+   * Collective binary output of the distributed factors at rank k. Every
+   * process writes its block at its global offset with one
+   * MPI_File_write_at_all, so each file holds the global factor as a
+   * dense row major array of doubles. W follows the rank order and H the
+   * column major grid order described in the README. Root writes a small
+   * JSON header next to the data that describes the layout.
+   * @param[in] Local W factor matrix
+   * @param[in] Local H factor matrix
+   * @param[in] iter perturbation run of the factors. -1 for the median
+   * @param[in] k low rank
+   * @param[in] output file name
+   */
+  void writeOutputBinary(const MAT& W, const MAT& H, int iter, int k,
+                         const std::string& output_file_name) {
+    std::stringstream sp;
+    sp << output_file_name << "_K" << k;
+    if (iter >= 0) sp << "_Run" << iter;
+    std::string wname = sp.str() + "_W.bin";
+    std::string hname = sp.str() + "_H.bin";
+    std::vector<int> wrows(MPI_SIZE), hrows(MPI_SIZE);
+    int mywrows = W.n_rows, myhrows = H.n_rows;
+    MPI_Allgather(&mywrows, 1, MPI_INT, &wrows[0], 1, MPI_INT, MPI_COMM_WORLD);
+    MPI_Allgather(&myhrows, 1, MPI_INT, &hrows[0], 1, MPI_INT, MPI_COMM_WORLD);
+    UWORD globalm = 0, globaln = 0, woffset = 0, hoffset = 0;
+    int mypos = gridOrder(MPI_RANK);
+    for (int r = 0; r < MPI_SIZE; r++) {
+      globalm += wrows[r];
+      globaln += hrows[r];
+      if (r < MPI_RANK) woffset += wrows[r];
+      if (gridOrder(r) < mypos) hoffset += hrows[r];
+    }
+    writeBinaryFactor(W, woffset, globalm, wname);
+    writeBinaryFactor(H, hoffset, globaln, hname);
+    if (MPI_RANK == 0) {
+      uint16_t one = 1;
+      bool little = *reinterpret_cast<uint8_t*>(&one) == 1;
+      std::ofstream hdr((sp.str() + ".json").c_str());
+      hdr << "{\"k\": " << k << ", \"run\": " << iter
+          << ", \"dtype\": \"float64\", \"order\": \"row_major\""
+          << ", \"endianness\": \"" << (little ? "little" : "big") << "\""
+          << ", \"procs\": " << MPI_SIZE;
+      if (m_distio == TWOD) {
+        hdr << ", \"pr\": " << m_mpicomm.pr()
+            << ", \"pc\": " << m_mpicomm.pc();
+      }
+      hdr << ",\n \"W\": {\"file\": \"" << baseName(wname)
+          << "\", \"rows\": " << globalm << ", \"cols\": " << k << "}"
+          << ",\n \"H\": {\"file\": \"" << baseName(hname)
+          << "\", \"rows\": " << globaln << ", \"cols\": " << k << "}}"
+          << std::endl;
+    }
+  }
+
   void writeSilhouettes(const MAT& Si, int &k, const std::string& output_silhouettes) {
     if(MPI_RANK == 0)   {
         std::stringstream si;
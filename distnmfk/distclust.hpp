@@ -232,8 +232,11 @@ class DistClust {
       }
       globalCosDist.zeros();
       // Calc global Cosine-distances or angular distances from Centroid to Ws in Wall
+      double bytes = 8.0 * this->m_k * this->m_k * this->m_slices;
+      MPITIC;
       MPI_Allreduce(localCosDist.memptr(), globalCosDist.memptr(), this->m_k * this->m_k * this->m_slices,
                 MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      this->time_stats.allreduce_duration(MPITOCTRACE("DistClust::cosdist", bytes), bytes);
       // Angular similarity or Cosine Similarity
       globalCosDist = 1 - globalCosDist;
 
@@ -293,6 +296,9 @@ class DistClust {
       double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
       PRINTROOT("completed clustering for k=" << this->m_k << "::taken::" << this->time_stats.duration());
       PRINTROOT("clustering elpased time = "<< elapsed_secs);
+      PRINTROOT("clustering comm::calls::" << this->time_stats.total_calls()
+                << "::bytes::" << this->time_stats.total_bytes()
+                << "::allreduce secs::" << this->time_stats.allreduce_duration());
     }
 
     /* Calculate a(i) = cosine_dist(i, j)*/
@@ -306,8 +312,11 @@ class DistClust {
         //cout<<"Shapes are "<<size(localaiDotProd)<<" and "<<size(tempClust)<<endl;
       
       }
+      double bytes = 8.0 * this->m_slices * this->m_slices * this->m_k;
+      MPITIC;
       MPI_Allreduce(localaiDotProd.memptr(), globalaiDotProd.memptr(), this->m_slices * this->m_slices * this->m_k,
               MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+      this->time_stats.allreduce_duration(MPITOCTRACE("DistClust::ai", bytes), bytes);
       // Following line is the most important, because we calc cosine similarity not cosine distance
       globalaiDotProd = 1 - globalaiDotProd;
       //cout<<"Shapes are "<<size(globalaiDotProd)<<" and "<<size((sum(this->globalaiDotProd.slice(0), 1) - 1) / (this->m_slices - 1))<<endl;
@@ -349,8 +358,11 @@ class DistClust {
         }
         globalbiDotProd.zeros();
         //partDotProd(ki, 0) = localbiDotProd;
+        double bytes = 8.0 * this->m_slices * this->m_slices * (this->m_k-1);
+        MPITIC;
         MPI_Allreduce(localbiDotProd.memptr(), globalbiDotProd.memptr(), this->m_slices * this->m_slices * (this->m_k-1),
               MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        this->time_stats.allreduce_duration(MPITOCTRACE("DistClust::bi", bytes), bytes);
         MPI_Barrier(MPI_COMM_WORLD);
         // Following is the most important, because we calc cosine similarity not cosine distance
         globalbiDotProd = arma::abs(1 - globalbiDotProd);
@@ -407,7 +419,8 @@ class DistClust {
       mpitic();
       MPI_Allreduce(localWcubenorm.memptr(), Wcubenorm.memptr(), this->m_k * this->m_slices, 
                 MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-      double temp = mpitoc();
+      double temp = mpitoc("DistClust::norm", 8.0 * this->m_k * this->m_slices);
+      this->time_stats.allreduce_duration(temp, 8.0 * this->m_k * this->m_slices);
       // if(MPI_RANK == 0) { 
       //  Wcubenorm.print("global Wcube_sq_norm "); 
       // }
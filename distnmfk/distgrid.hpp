@@ -0,0 +1,201 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file selects the processor grid pr x pc and the number of k blocks from the
+problem shape using the communication and memory cost model of HPC-NMF.
+*/
+
+#ifndef DISTNMF_DISTGRID_HPP_
+#define DISTNMF_DISTGRID_HPP_
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "../planc-master/common/utils.h"
+
+namespace planc {
+
+/**
+ * Cost model for the 2D HPC-NMF distribution. For a grid pr x pc,
+ * every outer iteration gathers the (m/pr) x k block of W along the row
+ * communicator and reduce-scatters the k x (n/pc) block of W^TA along the
+ * column communicator, and symmetrically for H. Per rank this moves
+ * 2k((m/pr)(1-1/pc) + (n/pc)(1-1/pr)) words plus the two k x k Gram
+ * allreduces, in 2 num_k_blocks (log pr + log pc) + 2 log p messages.
+ */
+class DistGrid {
+ private:
+  UWORD m_globalm, m_globaln;
+  int m_lowk, m_upk;
+  int m_numprocs;
+  double m_density;       /// fraction of nonzeros of A, 1 for dense
+  double m_membudget;     /// per rank bytes for A and the NMF buffers, 0=inf
+  bool m_dense_error;     /// two m/pr x n/pc buffers if num_k_blocks=1
+  int m_fixed_k_blocks;   /// num_k_blocks given by the user, 0 to choose
+
+  // chosen configuration and its estimates at the largest k
+  int m_pr, m_pc;
+  std::vector<int> m_k_blocks;  /// num_k_blocks of every k from lowk
+  double m_words, m_msgs, m_commsecs, m_membytes;
+
+  /// latency and inverse bandwidth used for the time estimate.
+  static constexpr double kAlpha = 2e-6;
+  static constexpr double kBeta = 8.0 / 5e9;
+
+  static double log2ceil(int p) { return p > 1 ? std::ceil(std::log2(p)) : 0; }
+
+  double words(int pr, int pc, int k) const {
+    double lm = static_cast<double>(m_globalm) / pr;
+    double ln = static_cast<double>(m_globaln) / pc;
+    return 2.0 * k * (lm * (1.0 - 1.0 / pc) + ln * (1.0 - 1.0 / pr)) +
+           2.0 * k * k;
+  }
+
+  /// log p messages per collective, not the calls counted by --timetrace
+  double msgs(int pr, int pc, int nkb) const {
+    return 2.0 * nkb * (log2ceil(pr) + log2ceil(pc)) +
+           2.0 * log2ceil(m_numprocs);
+  }
+
+  /**
+   * Bytes held per rank at rank k. The driver keeps the input block, its
+   * perturbed copy and the perturbation, the sparse case stores an index
+   * with every value. The factor buffers are W, H, their transposes and
+   * products plus the gathered blocks of size k/num_k_blocks.
+   */
+  double memory(int pr, int pc, int k, int nkb) const {
+    double lm = static_cast<double>(m_globalm) / pr;
+    double ln = static_cast<double>(m_globaln) / pc;
+    double ownedm = static_cast<double>(m_globalm) / m_numprocs;
+    double ownedn = static_cast<double>(m_globaln) / m_numprocs;
+    double perk = static_cast<double>(k) / nkb;
+#ifdef BUILD_SPARSE
+    double ablock = 2.0 * 16.0 * m_density * lm * ln;
+#else
+    double ablock = 3.0 * 8.0 * lm * ln;
+    if (m_dense_error && nkb == 1) ablock += 2.0 * 8.0 * lm * ln;
+#endif
+    double factors = 8.0 * 6.0 * k * (ownedm + ownedn);
+    double gathered = 8.0 * 4.0 * perk * (lm + ln);
+    return ablock + factors + gathered;
+  }
+
+  /**
+   * num_k_blocks for rank k on pr x pc, the smallest divisor of k whose
+   * buffers fit the budget, k if none does.
+   */
+  int kBlocks(int pr, int pc, int k) const {
+    if (m_fixed_k_blocks > 0) return m_fixed_k_blocks;
+    if (m_membudget <= 0) return 1;
+    for (int d = 1; d < k; d++) {
+      if (k % d == 0 && memory(pr, pc, k, d) <= m_membudget) return d;
+    }
+    return k;
+  }
+
+  /// whether every k of the sweep fits the budget on pr x pc
+  bool fits(int pr, int pc) const {
+    if (m_membudget <= 0) return true;
+    for (int k = m_lowk; k <= m_upk; k++) {
+      if (memory(pr, pc, k, kBlocks(pr, pc, k)) > m_membudget) return false;
+    }
+    return true;
+  }
+
+ public:
+  /**
+   * @param[in] m global rows of A
+   * @param[in] n global columns of A
+   * @param[in] lowk lowest rank of the NMFk sweep
+   * @param[in] upk highest rank of the NMFk sweep
+   * @param[in] p number of MPI processes
+   * @param[in] density fraction of nonzeros in A
+   * @param[in] membudget per rank memory budget in bytes. 0 for unlimited
+   * @param[in] dense_error whether the dense error buffers are allocated
+   * @param[in] numkblocks num_k_blocks to keep for every k, 0 to choose it
+   */
+  DistGrid(UWORD m, UWORD n, int lowk, int upk, int p, double density,
+           double membudget, bool dense_error, int numkblocks)
+      : m_globalm(m), m_globaln(n), m_lowk(lowk), m_upk(upk),
+        m_numprocs(p), m_density(density), m_membudget(membudget),
+        m_dense_error(dense_error), m_fixed_k_blocks(numkblocks) {
+    if (m_upk < m_lowk) m_upk = m_lowk;
+    choose();
+  }
+
+  /**
+   * Enumerates every factorization pr x pc = p and keeps the one with the
+   * smallest estimated communication time at the largest k. Grids on which
+   * some k of the sweep does not fit the budget are dropped, and grids that
+   * split the rows and columns of A evenly are preferred over the rest. If
+   * no grid fits, the cheapest one is taken and printEstimate warns. Every
+   * k gets its own num_k_blocks, see kBlocks.
+   */
+  void choose() {
+    double best = -1;
+    for (int fit = 1; fit >= 0 && best < 0; fit--) {
+      for (int even = 1; even >= 0 && best < 0; even--) {
+        for (int pr = 1; pr <= m_numprocs; pr++) {
+          if (m_numprocs % pr != 0) continue;
+          int pc = m_numprocs / pr;
+          if (even && (m_globalm % pr != 0 || m_globaln % pc != 0)) continue;
+          if (static_cast<UWORD>(pr) > m_globalm ||
+              static_cast<UWORD>(pc) > m_globaln)
+            continue;
+          if (fit && !fits(pr, pc)) continue;
+          double t = kAlpha * msgs(pr, pc, kBlocks(pr, pc, m_upk)) +
+                     kBeta * words(pr, pc, m_upk);
+          if (best < 0 || t < best) {
+            best = t;
+            m_pr = pr;
+            m_pc = pc;
+          }
+        }
+      }
+    }
+    if (best < 0) {
+      m_pr = m_numprocs;
+      m_pc = 1;
+    }
+    m_k_blocks.clear();
+    for (int k = m_lowk; k <= m_upk; k++)
+      m_k_blocks.push_back(kBlocks(m_pr, m_pc, k));
+    int nkb = num_k_blocks(m_upk);
+    m_words = words(m_pr, m_pc, m_upk);
+    m_msgs = msgs(m_pr, m_pc, nkb);
+    m_commsecs = kAlpha * m_msgs + kBeta * m_words;
+    m_membytes = memory(m_pr, m_pc, m_upk, nkb);
+  }
+
+  /// Prints the chosen grid and the model estimates for the largest k.
+  void printEstimate() const {
+    INFO << "autogrid::p::" << m_numprocs << "::pr::" << m_pr
+         << "::pc::" << m_pc << "::num_k_blocks::" << num_k_blocks(m_upk)
+         << "::k::" << m_upk << "::words/iter::" << m_words
+         << "::msgs/iter::" << m_msgs << "::commsecs/iter::" << m_commsecs
+         << "::bytes/rank::" << m_membytes << std::endl;
+    if (m_lowk < m_upk) {
+      INFO << "autogrid::num_k_blocks";
+      for (int k = m_lowk; k <= m_upk; k++)
+        INFO << "::k=" << k << ":" << num_k_blocks(k);
+      INFO << std::endl;
+    }
+    if (!fits(m_pr, m_pc)) {
+      WARN << "autogrid::no grid fits the budget of " << m_membudget
+           << " bytes per rank" << std::endl;
+    }
+  }
+
+  int pr() const { return m_pr; }
+  int pc() const { return m_pc; }
+  /// num_k_blocks chosen for rank k of the sweep
+  int num_k_blocks(int k) const { return m_k_blocks[k - m_lowk]; }
+  double words() const { return m_words; }
+  double msgs() const { return m_msgs; }
+  double membytes() const { return m_membytes; }
+};
+
+}  // namespace planc
+
+#endif  // DISTNMF_DISTGRID_HPP_
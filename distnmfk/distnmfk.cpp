@@ -19,6 +19,7 @@ number of components and silhouette statistics */
 #include "../planc-master/distnmf/naiveanlsbpp.hpp"
 #include "distreorder.hpp"
 #include "distclust.hpp"
+#include "distgrid.hpp"
 //#include "distbcd.hpp"
 #ifdef BUILD_CUDA
 #include <cuda.h>
@@ -26,6 +27,20 @@ number of components and silhouette statistics */
 #endif
 #define CUBE arma::cube
 #define FIELD arma::field
+
+// Element type of the perturbed input of the 2D algorithms. With
+// BUILD_MIXED_PRECISION the input block and the multiplies with it run in
+// float while the factors, the NNLS solves and the clustering stay double.
+#ifdef BUILD_MIXED_PRECISION
+#ifdef USE_PACOSS
+#error "BUILD_MIXED_PRECISION is not supported with USE_PACOSS"
+#endif
+#define INPUTMAT FMAT
+#define SP_INPUTMAT SP_FMAT
+#else
+#define INPUTMAT MAT
+#define SP_INPUTMAT SP_MAT
+#endif
 namespace planc {
 class DistNMFk  {
 private:
@@ -46,6 +61,7 @@ private:
   iodistributions m_distio;
   uint m_compute_error;
   int m_num_k_blocks;
+  std::vector<int> m_k_blocks;  /// num_k_blocks of every k, see chooseGrid
   static const int kprimeoffset = 17;
   static const int kPrimeOffset = 10;
   normtype m_input_normalization;
@@ -53,6 +69,22 @@ private:
   int upper_k;
   int num_perturbs;
   std::string m_outputfile_sils;
+  bool m_binary_output;
+  bool m_save_runs;
+  double m_noise;
+  double m_colskew;
+  int m_planted_k;
+  std::string m_truth_file_name;
+  bool m_overlap;
+  bool m_nodegather;
+  int m_errcheck;
+  int m_inneriter;
+  double m_innertol;
+  algotype m_innersolver;
+  int m_admmiter;
+  double m_admmtol;
+  std::string m_timetrace_prefix;
+  std::string m_chrometrace_file;
 
 #ifdef BUILD_CUDA
   void printDevProp(cudaDeviceProp devProp) {
@@ -111,6 +143,49 @@ private:
          << "::normtype::" << this->m_input_normalization << std::endl;
   }
 
+  /// num_k_blocks of the runs at rank k
+  int kBlocks(int k) const {
+    return m_k_blocks.empty() ? m_num_k_blocks : m_k_blocks[k - m_k];
+  }
+
+  /**
+   * Replaces pr and pc with the grid of least estimated communication
+   * from DistGrid and picks num_k_blocks for every k, except that a given
+   * --numkblocks is kept. MPI is initialized here because the number of
+   * processes is needed before the 2D communicator is built.
+   * @param[in] memlimit per process memory budget in GiB. 0 is unlimited
+   * @param[in] keepkblocks whether to keep m_num_k_blocks for every k
+   */
+  void chooseGrid(double memlimit, bool keepkblocks) {
+    int initialized, rank, size;
+    MPI_Initialized(&initialized);
+    if (!initialized) MPI_Init(&this->m_argc, &this->m_argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    double density = 1.0;
+#ifdef BUILD_SPARSE
+    density = this->m_sparsity;
+#endif  // ifdef BUILD_SPARSE
+    DistGrid grid(this->m_globalm, this->m_globaln, this->m_k, this->upper_k,
+                  size, density, memlimit * 1024 * 1024 * 1024,
+                  this->m_compute_error && this->m_errcheck > 0,
+                  keepkblocks ? this->m_num_k_blocks : 0);
+    this->m_pr = grid.pr();
+    this->m_pc = grid.pc();
+    this->m_num_k_blocks = grid.num_k_blocks(this->upper_k);
+    this->m_k_blocks.clear();
+    for (int k = this->m_k; k <= this->upper_k; k++)
+      this->m_k_blocks.push_back(grid.num_k_blocks(k));
+    if (rank == 0) {
+      grid.printEstimate();
+      std::string rand_prefix("rand_");
+      if (m_Afile_name.compare(0, rand_prefix.size(), rand_prefix) != 0) {
+        WARN << "autogrid::input files must be split for the grid "
+             << this->m_pr << "x" << this->m_pc << std::endl;
+      }
+    }
+  }
+
 template <class NMFTYPE>
   void nmfk1D() {
     std::string rand_prefix("rand_");
@@ -150,8 +225,12 @@ template <class NMFTYPE>
     Arows_new.zeros();
     MAT Acols_new(dio.Acols());
     Acols_new.zeros();
+#ifdef BUILD_SPARSE
+    SP_MAT Beta = arma::spones(Arows);
+#else   // ifdef BUILD_SPARSE
     MAT Beta(Arows.n_rows, Arows.n_cols);
     Beta.ones();
+#endif  // ifdef BUILD_SPARSE
     Acols_new = Acols + Acols_new;
     Arows_new = Arows + Arows_new;
     // nmfk main loop -- Iterate over k=2:100 (you can get it from cmd later)
@@ -202,6 +281,9 @@ template <class NMFTYPE>
 void nmfK2D() {
   std::string rand_prefix("rand_");
   MPICommunicator mpicomm(this->m_argc, this->m_argv, this->m_pr, this->m_pc);
+  if (!this->m_chrometrace_file.empty()) {
+    DistTracer::instance().enable(MPI_COMM_WORLD);
+  }
   // #ifdef BUILD_CUDA
   //         if (mpicomm.rank()==0){
   //             gpuQuery();
@@ -253,9 +335,14 @@ void nmfK2D() {
   DistIO<MAT> dio(mpicomm, m_distio);
 #endif  // ifdef BUILD_SPARSE. One outstanding PACOSS
   if (m_Afile_name.compare(0, rand_prefix.size(), rand_prefix) == 0) {
-    dio.readInput(m_Afile_name, this->m_globalm, this->m_globaln, this->m_k,
-                  this->m_sparsity, this->m_pr, this->m_pc,
+    dio.plantedParams(this->m_noise, this->m_colskew);
+    dio.readInput(m_Afile_name, this->m_globalm, this->m_globaln,
+                  this->m_planted_k, this->m_sparsity, this->m_pr, this->m_pc,
                   this->m_input_normalization);
+    if (m_Afile_name == "rand_planted" && !m_truth_file_name.empty()) {
+      dio.writePlantedTruth(this->m_globalm, this->m_globaln,
+                            this->m_planted_k, m_truth_file_name);
+    }
   } else {
     dio.readInput(m_Afile_name);
   }
@@ -281,12 +368,45 @@ void nmfK2D() {
   dio.writeRandInput();
 #endif  // ifdef WRITE_RAND_INPUT
 #endif  // ifdef USE_PACOSS. Everything over. No more outstanding ifdef's.
-  MAT A_new(A.n_rows, A.n_cols);
+#ifdef BUILD_SPARSE
+  // perturbed in place on the pattern of A every run
+  SP_INPUTMAT A_new(arma::uvec(A.row_indices, A.n_nonzero),
+                    arma::uvec(A.col_ptrs, A.n_cols + 1),
+                    arma::Col<SP_INPUTMAT::elem_type>(A.n_nonzero), A.n_rows,
+                    A.n_cols);
+#else   // ifdef BUILD_SPARSE
+  INPUTMAT A_new(A.n_rows, A.n_cols);
   MAT Beta(A.n_rows, A.n_cols);
+#endif  // ifdef BUILD_SPARSE
   // A_new.zeros();
   // Beta.ones();
   // A_new = ( A + A_new ) % (Beta);
 
+  // the large buffers of the multiplies are sized once for upper_k and
+  // borrowed by every run
+  bool dense_error = this->m_compute_error && this->m_errcheck > 0;
+#ifdef BUILD_SPARSE
+  dense_error = false;
+#endif  // ifdef BUILD_SPARSE
+  int maxperk = 0;
+  bool kblocked = false, unblocked = false;
+  for (int k = this->m_k; k <= this->upper_k; k++) {
+    maxperk = std::max(maxperk, k / kBlocks(k));
+    kblocked = kblocked || kBlocks(k) > 1;
+    unblocked = unblocked || kBlocks(k) == 1;
+  }
+  // --errcheck is off for the k-blocked runs, see set_errcheck
+  dense_error = dense_error && unblocked;
+  double wsbytes = NMFTYPE::reserveWorkspace(
+      A_new.n_rows, A_new.n_cols, maxperk, dense_error,
+      this->m_overlap && kblocked, this->m_nodegather && !this->m_overlap);
+  if (mpicomm.rank() == 0) {
+    INFO << "workspace::bytes/rank::" << wsbytes << std::endl;
+  }
+#ifndef USE_PACOSS
+  DistInputContext::instance().dims(A_new.n_rows, A_new.n_cols, mpicomm);
+#endif  // ifndef USE_PACOSS
+
   // nmfk main loop -- Iterate over k=2:100 (you can get it from cmd later)
   // For each 'k', run nmf for 30 iter with a small perturbation in A.
   //for(int k=2; k < this->m_globaln/2; k++) {
@@ -305,10 +425,15 @@ void nmfK2D() {
       // same matrix as only one of them will be used.
       arma::arma_rng::set_seed(mpicomm.rank() + k + iter);
       //Perturbations with an error rate
-      Beta.zeros();
-      A_new.zeros();
+#ifdef BUILD_SPARSE
+      double sqnorm = dio.perturbNonzeros(
+          A, mpicomm.rank() + kPrimeOffset + k + iter, &A_new);
+#else   // ifdef BUILD_SPARSE
       dio.randBetaMatrix("uniform", mpicomm.rank() +  kPrimeOffset + k + iter, &Beta);
-      A_new = ( A + A_new ) % (Beta);
+      double sqnorm = dio.perturbDense(A, Beta, &A_new);
+#endif  // ifdef BUILD_SPARSE
+      // the NMF objects of this run take the norm of A_new from here
+      DistInputContext::instance().update(&A_new, sqnorm);
       // Print A_new
       //dio.writeRandInput(); // Need to change this function
 #ifdef USE_PACOSS
@@ -325,10 +450,10 @@ void nmfK2D() {
 #ifndef USE_PACOSS
 #ifdef BUILD_SPARSE
       if (m_nmfalgo == ANLSBPP) {
-        DistHALS<SP_MAT> lrinitializer(A_new + Beta, W, H, mpicomm, this->m_num_k_blocks, this->m_outputfile_sils);
+        DistHALS<SP_INPUTMAT> lrinitializer(A_new, W, H, mpicomm, kBlocks(k), this->m_outputfile_sils);
         lrinitializer.num_iterations(4);
         lrinitializer.algorithm(HALS);
-        lrinitializer.computeNMFwithConv();
+        lrinitializer.computeNMF();
         W = lrinitializer.getLeftLowRankFactor();
         H = lrinitializer.getRightLowRankFactor();
       }
@@ -343,7 +468,7 @@ void nmfK2D() {
 #endif  // ifdef MPI_VERBOSE
       // MPI_Barrier(MPI_COMM_WORLD);
       memusage(mpicomm.rank(), "b4 constructor ");
-      NMFTYPE nmfAlgorithm(A_new, W, H, mpicomm, this->m_num_k_blocks, this->m_outputfile_sils);
+      NMFTYPE nmfAlgorithm(A_new, W, H, mpicomm, kBlocks(k), this->m_outputfile_sils);
 #ifdef USE_PACOSS
       nmfAlgorithm.set_rowcomm(rowcomm);
       nmfAlgorithm.set_colcomm(colcomm);
@@ -354,7 +479,20 @@ void nmfK2D() {
       nmfAlgorithm.algorithm(this->m_nmfalgo);
       nmfAlgorithm.regW(this->m_regW);
       nmfAlgorithm.regH(this->m_regH);
+      nmfAlgorithm.set_overlap(this->m_overlap);
+      nmfAlgorithm.set_nodegather(this->m_nodegather);
+      nmfAlgorithm.set_errcheck(this->m_errcheck);
+      nmfAlgorithm.set_inneriter(this->m_inneriter, this->m_innertol);
+      nmfAlgorithm.set_extrapolate(this->m_nmfalgo == NESTEROV);
+      nmfAlgorithm.set_admm(this->m_admmiter, this->m_admmtol);
+      if (!this->m_timetrace_prefix.empty()) {
+        std::stringstream st;
+        st << this->m_timetrace_prefix << "_K" << k << "_Run" << iter
+           << ".csv";
+        nmfAlgorithm.trace_file(st.str());
+      }
       // MPI_Barrier(MPI_COMM_WORLD);
+      DistTracer::instance().context(k, iter);
       try {
           mpitic();
           //if (this->m_nmfalgo == BCD)  {
@@ -363,7 +501,7 @@ void nmfK2D() {
             // nmfAlgorithm.computeNMFwithConv();
             nmfAlgorithm.computeNMF();
           //}
-          double temp = mpitoc();
+          double temp = mpitoc("NMF");
           if (mpicomm.rank() == 0) printf("NMF took %.3lf secs.\n", temp);
       } catch (std::exception &e) {
           printf("Failed rank %d: %s\n", mpicomm.rank(), e.what());
@@ -391,8 +529,17 @@ void nmfK2D() {
 
 //if(mpicomm.rank() == 0) printf("Objective error %.3lf \n", this->objective_err);
 //if(mpicomm.rank() == 0) printf("Relative error %.3lf \n", this->objective_err/nmfAlgorithm.globalsqnorma());
-      // For testing purposes only
-      // dio.writeOutput(Wall.slice(iter), Hall.slice(iter), iter, curr_k, m_outputfile_name);
+#ifndef USE_PACOSS
+      if (this->m_save_runs && !m_outputfile_name.empty()) {
+        if (this->m_binary_output) {
+          dio.writeOutputBinary(Wall.slice(iter), Hall.slice(iter), iter,
+                                curr_k, m_outputfile_name);
+        } else {
+          dio.writeOutput(Wall.slice(iter), Hall.slice(iter), iter, curr_k,
+                          m_outputfile_name);
+        }
+      }
+#endif  // ifndef USE_PACOSS
 
       //MPI_Barrier(MPI_COMM_WORLD);
     } // End for loop 'iter'
@@ -403,13 +550,18 @@ void nmfK2D() {
     } 
     */
    DistClust<MAT> dc(Wall, Hall, mpicomm, curr_k);
+   DistTracer::instance().context(curr_k, -1);
    mpitic();
    dc.distReorder();
-   double temp1 = mpitoc();
+   double temp1 = mpitoc("DistClust::reorder");
    if(mpicomm.rank() == 0) printf("DistClust took %.3lf secs.\n", temp1);
    //dc.distMedian();
 #ifndef USE_PACOSS
-  if (!m_outputfile_name.empty()) {
+  if (!m_outputfile_name.empty() && this->m_binary_output) {
+    dio.writeOutputBinary(dc.getLeftLowRankFactor(),
+                          dc.getRightLowRankFactor(), -1, curr_k,
+                          m_outputfile_name);
+  } else if (!m_outputfile_name.empty()) {
     dio.writeOutput(dc.getLeftLowRankFactor(), dc.getRightLowRankFactor(), runs, curr_k, m_outputfile_name);
     /*
     MPI_Allgather(dc.getLeftLowRankFactor().memptr(), (this->m_globalm / mpicomm.size()*curr_k), MPI_DOUBLE, Wout.memptr(), (this->m_globalm / mpicomm.size()*curr_k), MPI_DOUBLE, MPI_COMM_WORLD);
@@ -425,7 +577,7 @@ void nmfK2D() {
 #endif  // ifndef USE_PACOSS
    mpitic();
    dc.distClustStability(); 
-   double temp2 = mpitoc();
+   double temp2 = mpitoc("DistClust::stability");
    if(mpicomm.rank() == 0) printf("DistClustStability took %.3lf secs.\n", temp2);
 
    if(!m_outputfile_sils.empty()) {
@@ -436,6 +588,8 @@ void nmfK2D() {
    Wall.clear();
    Hall.clear();
   } //End of for loop 'k (rank)'
+  DistInputContext::instance().clear();
+  DistTracer::instance().write(this->m_chrometrace_file, MPI_COMM_WORLD);
  }
 
 void parseCommandLine() {
@@ -452,7 +606,7 @@ void parseCommandLine() {
     this->m_distio = TWOD;
     this->m_regW = pc.regW();
     this->m_regH = pc.regH();
-    this->m_num_k_blocks = 1;
+    this->m_num_k_blocks = pc.num_k_blocks();
     this->m_globalm = pc.globalm();
     this->m_globaln = pc.globaln();
     this->m_compute_error = pc.compute_error();
@@ -460,6 +614,22 @@ void parseCommandLine() {
     this->upper_k = pc.upper_limit_k();
     this->num_perturbs = pc.perturbs();
     this->m_outputfile_sils = pc.output_silhouettes();
+    this->m_binary_output = pc.binary_output();
+    this->m_save_runs = pc.save_runs();
+    this->m_noise = pc.noise();
+    this->m_colskew = pc.colskew();
+    this->m_planted_k = pc.planted_k() > 0 ? pc.planted_k() : pc.lowrankk();
+    this->m_truth_file_name = pc.truth_file_name();
+    this->m_overlap = pc.overlap();
+    this->m_nodegather = pc.nodegather();
+    this->m_errcheck = pc.errcheck();
+    this->m_inneriter = pc.inneriter();
+    this->m_innertol = pc.innertol();
+    this->m_innersolver = pc.innersolver();
+    this->m_admmiter = pc.admmiter();
+    this->m_admmtol = pc.admmtol();
+    this->m_timetrace_prefix = pc.timetrace_prefix();
+    this->m_chrometrace_file = pc.chrometrace_file();
    // this->objective_err = pc.objective_error();
     if (this->m_nmfalgo == NAIVEANLSBPP) {
       this->m_distio = ONED_DOUBLE;
@@ -469,26 +639,31 @@ void parseCommandLine() {
     this->m_input_normalization = pc.input_normalization();
     //pc.printConfig();
     pc.printNMFkConfig();
+#ifndef USE_PACOSS
+    if (pc.autogrid() && this->m_distio == TWOD) {
+      chooseGrid(pc.memlimit(), pc.num_k_blocks_given());
+    }
+#endif  // ifndef USE_PACOSS
     switch (this->m_nmfalgo) {
       case MU:
 #ifdef BUILD_SPARSE
-        nmfK2D<DistMU<SP_MAT> >();
+        nmfK2D<DistMU<SP_INPUTMAT> >();
 #else   // ifdef BUILD_SPARSE
-        nmfK2D<DistMU<MAT> >();
+        nmfK2D<DistMU<INPUTMAT> >();
 #endif  // ifdef BUILD_SPARSE
         break;
       case HALS:
 #ifdef BUILD_SPARSE
-        nmfK2D<DistHALS<SP_MAT> >();
+        nmfK2D<DistHALS<SP_INPUTMAT> >();
 #else   // ifdef BUILD_SPARSE
-        nmfK2D<DistHALS<MAT> >();
+        nmfK2D<DistHALS<INPUTMAT> >();
 #endif  // ifdef BUILD_SPARSE
         break;
       case ANLSBPP:
 #ifdef BUILD_SPARSE
-        nmfK2D<DistANLSBPP<SP_MAT> >();
+        nmfK2D<DistANLSBPP<SP_INPUTMAT> >();
 #else   // ifdef BUILD_SPARSE
-        nmfK2D<DistANLSBPP<MAT> >();
+        nmfK2D<DistANLSBPP<INPUTMAT> >();
 #endif  // ifdef BUILD_SPARSE
         break;
       case NAIVEANLSBPP:
@@ -498,17 +673,34 @@ void parseCommandLine() {
         nmfk1D<DistNaiveANLSBPP<MAT> >();
 #endif  // ifdef BUILD_SPARSE
         break;
+      case NESTEROV:
+        // extrapolated ANLS/BPP or HALS, see DistAUNMF::set_extrapolate
+        if (this->m_innersolver == HALS) {
+#ifdef BUILD_SPARSE
+          nmfK2D<DistHALS<SP_INPUTMAT> >();
+#else   // ifdef BUILD_SPARSE
+          nmfK2D<DistHALS<INPUTMAT> >();
+#endif  // ifdef BUILD_SPARSE
+        } else {
+#ifdef BUILD_SPARSE
+          nmfK2D<DistANLSBPP<SP_INPUTMAT> >();
+#else   // ifdef BUILD_SPARSE
+          nmfK2D<DistANLSBPP<INPUTMAT> >();
+#endif  // ifdef BUILD_SPARSE
+        }
+        break;
       case AOADMM:
 #ifdef BUILD_SPARSE
-        nmfK2D<DistAOADMM<SP_MAT> >();
+        nmfK2D<DistAOADMM<SP_INPUTMAT> >();
 #else   // ifdef BUILD_SPARSE
-        nmfK2D<DistAOADMM<MAT> >();
+        nmfK2D<DistAOADMM<INPUTMAT> >();
 #endif  // ifdef BUILD_SPARSE
+        break;
       case CPALS:
 #ifdef BUILD_SPARSE
-        nmfK2D<DistALS<SP_MAT> >();
+        nmfK2D<DistALS<SP_INPUTMAT> >();
 #else   // ifdef BUILD_SPARSE
-        nmfK2D<DistALS<MAT> >();
+        nmfK2D<DistALS<INPUTMAT> >();
 #endif  // ifdef BUILD_SPARSE
 //      case BCD:
 //#ifdef BUILD_SPARSE
@@ -0,0 +1,155 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file holds the warm started active set NNLS that BPPNNLS falls back to.
+*/
+
+#ifndef DISTNMF_NNLS_ACTIVESET_HPP_
+#define DISTNMF_NNLS_ACTIVESET_HPP_
+
+#ifdef MKL_FOUND
+#include <mkl.h>
+#else
+#include <lapacke.h>
+#endif
+#include <armadillo>
+#include <cfloat>
+#include <cmath>
+#include <vector>
+#include "../planc-master/common/utils.h"
+
+/**
+ * Lawson and Hanson's active set NNLS on the normal equations, in the
+ * form of Bro and de Jong, J. Chemometrics 1997; 11: 393-401. Solves
+ * AtA x = b, x >= 0 for the gram matrix itself, while ActiveSetNNLS solves
+ * the least squares problem of AtA and b. The iteration starts from a
+ * given x, so it picks up where BPP gave up, and terminates in finitely
+ * many steps. The workspace is kept between solves and there is no static
+ * state, so one solver per thread may run concurrently.
+ */
+class GramActiveSetNNLS {
+ private:
+  UWORD m_n;
+  std::vector<double> m_sub;     /// AtA(P, P), factored in place
+  std::vector<double> m_rhs;     /// b(P), then the solution on P
+  std::vector<double> m_s;       /// trial solution, zero outside P
+  std::vector<int> m_idx;        /// indices of P
+  std::vector<char> m_passive;   /// 1 on the passive set P
+
+  /// m_s = AtA(P, P) \ b(P) on P and 0 elsewhere
+  void solvePassive(const double *AtA, const double *b) {
+    int np = 0;
+    for (UWORD i = 0; i < m_n; i++)
+      if (m_passive[i]) m_idx[np++] = i;
+    for (int j = 0; j < np; j++) {
+      for (int i = 0; i < np; i++)
+        m_sub[j * np + i] = AtA[m_idx[j] * m_n + m_idx[i]];
+      m_rhs[j] = b[m_idx[j]];
+    }
+    for (UWORD i = 0; i < m_n; i++) m_s[i] = 0;
+    if (np == 0) return;
+    int info = LAPACKE_dposv(LAPACK_COL_MAJOR, 'U', np, 1, &m_sub[0], np,
+                             &m_rhs[0], np);
+    if (info != 0) {
+      // singular AtA(P, P), least norm solution
+      arma::mat sub(np, np);
+      arma::vec rhs(np);
+      for (int j = 0; j < np; j++) {
+        for (int i = 0; i < np; i++)
+          sub(i, j) = AtA[m_idx[j] * m_n + m_idx[i]];
+        rhs(j) = b[m_idx[j]];
+      }
+      rhs = arma::pinv(sub) * rhs;
+      for (int j = 0; j < np; j++) m_rhs[j] = rhs(j);
+    }
+    for (int j = 0; j < np; j++) m_s[m_idx[j]] = m_rhs[j];
+  }
+
+ public:
+  GramActiveSetNNLS() : m_n(0) {}
+
+  /// sizes the workspace for n x n gram matrices
+  void reserve(UWORD n) {
+    m_n = n;
+    if (m_s.size() >= n) return;
+    m_sub.resize(n * n);
+    m_rhs.resize(n);
+    m_s.resize(n);
+    m_idx.resize(n);
+    m_passive.resize(n);
+  }
+
+  /**
+   * @param[in] AtA n x n column major gram matrix
+   * @param[in] b right hand side of length n
+   * @param[in,out] x start of the iteration, the entries that are not
+   *                positive start in the active set. The solution on
+   *                return.
+   * @return number of steps, -1 if the limit of 3n steps was reached. x
+   *         is feasible in either case.
+   */
+  int solve(const double *AtA, UWORD n, const double *b, double *x) {
+    reserve(n);
+    double anorm = 0;
+    for (UWORD j = 0; j < n; j++) {
+      double colsum = 0;
+      for (UWORD i = 0; i < n; i++) colsum += std::abs(AtA[j * n + i]);
+      anorm = std::max(anorm, colsum);
+    }
+    const double tol = 10 * DBL_EPSILON * anorm * n;
+    bool inner = false;
+    for (UWORD i = 0; i < n; i++) {
+      m_passive[i] = x[i] > tol;
+      if (!m_passive[i]) x[i] = 0;
+      inner = inner || m_passive[i];
+    }
+    const int maxit = 3 * n;
+    int it = 0;
+    while (true) {
+      if (!inner) {
+        // the most violated entry of the active set joins P
+        int t = -1;
+        double wmax = tol;
+        for (UWORD i = 0; i < n; i++) {
+          if (m_passive[i]) continue;
+          double w = b[i];
+          for (UWORD j = 0; j < n; j++) w -= AtA[j * n + i] * x[j];
+          if (w > wmax) {
+            wmax = w;
+            t = i;
+          }
+        }
+        if (t < 0) return it;
+        if (it >= maxit) return -1;
+        m_passive[t] = 1;
+        it++;
+      }
+      inner = false;
+      while (true) {
+        solvePassive(AtA, b);
+        double alpha = 2;
+        for (UWORD i = 0; i < n; i++) {
+          if (m_passive[i] && m_s[i] <= tol)
+            alpha = std::min(alpha, x[i] / (x[i] - m_s[i]));
+        }
+        if (alpha > 1) {
+          for (UWORD i = 0; i < n; i++) x[i] = m_s[i];
+          break;
+        }
+        // step back to the boundary and drop the entries that reach it
+        for (UWORD i = 0; i < n; i++) {
+          if (!m_passive[i]) continue;
+          x[i] += alpha * (m_s[i] - x[i]);
+          if (x[i] <= tol) {
+            x[i] = 0;
+            m_passive[i] = 0;
+          }
+        }
+        if (++it > maxit) return -1;
+      }
+    }
+  }
+};
+
+#endif  // DISTNMF_NNLS_ACTIVESET_HPP_
@@ -0,0 +1,270 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file holds the block principal pivoting NNLS that solves several right hand sides per SIMD lane group.
+*/
+
+#ifndef DISTNMF_NNLS_BATCH_HPP_
+#define DISTNMF_NNLS_BATCH_HPP_
+
+#include <stdint.h>
+#include <cmath>
+#include "../planc-master/common/utils.h"
+#include "nnls_bpp_small.hpp"
+
+namespace planc {
+
+/// right hand sides solved together, one per SIMD lane
+#define BPP_BATCH_LANES 8
+
+// With 128 bit vectors the masked solves of the full K x K matrix cost
+// more than the per row solves of AtA(F, F), so the batch is only used
+// when the build targets 256 bit vectors or wider.
+#if defined(__AVX2__) || defined(__AVX512F__)
+#define BPP_BATCH_SIMD 1
+#endif
+
+/**
+ * Block principal pivoting for BPP_BATCH_LANES right hand sides of the
+ * same K x K gram matrix. Every lane pivots on its own passive set with
+ * the rules of SmallBPP, but the linear solves of all the lanes run
+ * together. The right hand sides, the iterates and the lane's matrix,
+ * AtA on F x F and the identity elsewhere, are stored lane index fastest,
+ * so the Cholesky factorization and the triangular solves are vector
+ * operations over the lanes. The identity rows leave the F block
+ * untouched, the solution is the one of SmallBPP. The loops over the
+ * lanes carry omp simd and use AVX2 or AVX-512 with the matching -march,
+ * otherwise they run with the baseline instructions.
+ *
+ * Every lane is checked against the KKT conditions the pivoting stops on.
+ * A lane that does not satisfy them within 2K pivots, or whose AtA(F, F)
+ * is not positive definite, is reported back and left to the exact
+ * per row solvers.
+ * @tparam K rank, 2 <= K <= BPP_SMALL_MAX_K
+ */
+template <int K>
+class BatchBPP {
+ private:
+  static const int L = BPP_BATCH_LANES;
+
+  struct Batch {
+    double A[K][K][L];  /// lower factor of the masked matrix, column major
+    double f[K][L];     /// 1 on the passive set, 0 elsewhere
+    double b[K][L];
+    double x[K][L];
+    double y[K][L];
+  };
+
+  /**
+   * Solves the masked systems of all the lanes and sets x and y of the
+   * lanes in open like SmallBPP. The other lanes keep theirs.
+   * @return lanes whose AtA(F, F) is not positive definite
+   */
+  static unsigned solvePassive(const double *AtA, const uint64_t *F,
+                               unsigned open, Batch *s) {
+    double z[K][L];
+    double pd[L];
+    for (int i = 0; i < K; i++)
+      for (int l = 0; l < L; l++) s->f[i][l] = (F[l] >> i) & 1;
+    for (int l = 0; l < L; l++) pd[l] = 1;
+    for (int j = 0; j < K; j++) {
+      for (int i = j; i < K; i++) {
+        double aij = AtA[j * K + i];
+        double eye = i == j;
+#pragma omp simd
+        for (int l = 0; l < L; l++)
+          s->A[j][i][l] = s->f[i][l] * s->f[j][l] * aij +
+                          eye * (1 - s->f[i][l]);
+      }
+#pragma omp simd
+      for (int l = 0; l < L; l++) z[j][l] = s->f[j][l] * s->b[j][l];
+    }
+    for (int j = 0; j < K; j++) {
+      for (int p = 0; p < j; p++) {
+        for (int i = j; i < K; i++) {
+#pragma omp simd
+          for (int l = 0; l < L; l++)
+            s->A[j][i][l] -= s->A[p][i][l] * s->A[p][j][l];
+        }
+      }
+      double d[L];
+#pragma omp simd
+      for (int l = 0; l < L; l++) {
+        double djj = s->A[j][j][l];
+        pd[l] = djj > 0 ? pd[l] : 0;
+        d[l] = djj > 0 ? 1.0 / std::sqrt(djj) : 1;
+      }
+      for (int i = j; i < K; i++) {
+#pragma omp simd
+        for (int l = 0; l < L; l++) s->A[j][i][l] *= d[l];
+      }
+    }
+    for (int j = 0; j < K; j++) {
+#pragma omp simd
+      for (int l = 0; l < L; l++) z[j][l] /= s->A[j][j][l];
+      for (int i = j + 1; i < K; i++) {
+#pragma omp simd
+        for (int l = 0; l < L; l++) z[i][l] -= s->A[j][i][l] * z[j][l];
+      }
+    }
+    for (int j = K - 1; j >= 0; j--) {
+      for (int i = j + 1; i < K; i++) {
+#pragma omp simd
+        for (int l = 0; l < L; l++) z[j][l] -= s->A[j][i][l] * z[i][l];
+      }
+#pragma omp simd
+      for (int l = 0; l < L; l++) z[j][l] /= s->A[j][j][l];
+    }
+    // a select, the lanes that are not open may hold inf or nan in z
+    bool keep[L];
+    for (int l = 0; l < L; l++) keep[l] = !((open >> l) & 1);
+    double g[K][L];
+    for (int i = 0; i < K; i++) {
+#pragma omp simd
+      for (int l = 0; l < L; l++) g[i][l] = -s->b[i][l];
+    }
+    for (int j = 0; j < K; j++) {
+      for (int i = 0; i < K; i++) {
+        double aij = AtA[j * K + i];
+#pragma omp simd
+        for (int l = 0; l < L; l++) g[i][l] += aij * z[j][l];
+      }
+    }
+    for (int i = 0; i < K; i++) {
+#pragma omp simd
+      for (int l = 0; l < L; l++) {
+        double xi = std::abs(z[i][l]) < EPSILON_1EMINUS12 ? 0 : z[i][l];
+        double yi = (1 - s->f[i][l]) * g[i][l];
+        yi = std::abs(yi) < EPSILON_1EMINUS12 ? 0 : yi;
+        s->x[i][l] = keep[l] ? s->x[i][l] : xi;
+        s->y[i][l] = keep[l] ? s->y[i][l] : yi;
+      }
+    }
+    unsigned failed = 0;
+    for (int l = 0; l < L; l++)
+      if (pd[l] == 0) failed |= 1u << l;
+    return failed & open;
+  }
+
+ public:
+  /**
+   * @param[in] AtA K x K column major gram matrix
+   * @param[in] rhs column major K x count right hand sides, leading dim K
+   * @param[in] count number of right hand sides, at most BPP_BATCH_LANES
+   * @param[out] x count x K solutions with leading dimension ldx
+   * @param[in,out] passive K x count passive sets the lanes start from,
+   *                replaced by x > 0 for the lanes that converged
+   * @return bit mask of the lanes that converged. x and passive of the
+   *         others are left unchanged.
+   */
+  static unsigned solve(const double *AtA, const double *rhs, int count,
+                        double *x, UWORD ldx, UWORD *passive) {
+    Batch s;
+    uint64_t F[L];
+    int alpha[L], beta[L];
+    for (int l = 0; l < L; l++) {
+      F[l] = 0;
+      alpha[l] = 3;
+      beta[l] = K + 1;
+      for (int i = 0; i < K; i++) {
+        s.b[i][l] = l < count ? rhs[l * K + i] : 0;
+        if (l < count && passive[l * K + i] != 0) F[l] |= uint64_t(1) << i;
+      }
+    }
+    unsigned open = 0;
+    for (int l = 0; l < count; l++) open |= 1u << l;
+    // cold lanes start from x = 0, y = -b like BPPNNLS
+    for (int i = 0; i < K; i++) {
+      for (int l = 0; l < L; l++) {
+        s.x[i][l] = 0;
+        s.y[i][l] = -s.b[i][l];
+      }
+    }
+    unsigned warm = 0;
+    for (int l = 0; l < count; l++)
+      if (F[l] != 0) warm |= 1u << l;
+    unsigned failed = 0;
+    if (warm != 0) failed = solvePassive(AtA, F, warm, &s);
+    open &= ~failed;
+    unsigned done = 0;
+    for (int it = 0; it < 2 * K && open != 0; it++) {
+      int single[L];
+      for (int l = 0; l < L; l++) {
+        single[l] = -1;
+        if (!((open >> l) & 1)) continue;
+        uint64_t V = 0;
+        for (int i = 0; i < K; i++)
+          if ((F[l] >> i) & 1 ? s.x[i][l] < 0 : s.y[i][l] < 0)
+            V |= uint64_t(1) << i;
+        if (V == 0) {
+          done |= 1u << l;
+          open &= ~(1u << l);
+          continue;
+        }
+        int numv = __builtin_popcountll(V);
+        if (numv < beta[l]) {
+          beta[l] = numv;
+          alpha[l] = 3;
+        } else if (alpha[l] >= 1) {
+          alpha[l]--;
+        } else {
+          single[l] = 63 - __builtin_clzll(V);
+          V = uint64_t(1) << single[l];
+        }
+        F[l] ^= V;
+      }
+      if (open == 0) break;
+      unsigned bad = solvePassive(AtA, F, open, &s);
+      open &= ~bad;
+      // Lawson and Hanson's fix, see BPPNNLS
+      for (int l = 0; l < L; l++) {
+        if (((open >> l) & 1) && single[l] >= 0 &&
+            s.x[single[l]][l] < 0) {
+          s.x[single[l]][l] = 0;
+          s.y[single[l]][l] = 0;
+        }
+      }
+    }
+    for (int l = 0; l < count; l++) {
+      if (!((done >> l) & 1)) continue;
+      for (int i = 0; i < K; i++) {
+        x[i * ldx + l] = s.x[i][l];
+        passive[l * K + i] = s.x[i][l] > 0;
+      }
+    }
+    return done;
+  }
+};
+
+typedef unsigned (*BatchBPPKernel)(const double *, const double *, int,
+                                   double *, UWORD, UWORD *);
+
+template <int K>
+struct BatchBPPTable {
+  static void fill(BatchBPPKernel *table) {
+    table[K] = &BatchBPP<K>::solve;
+    BatchBPPTable<K - 1>::fill(table);
+  }
+};
+template <>
+struct BatchBPPTable<1> {
+  static void fill(BatchBPPKernel *) {}
+};
+
+/// batched kernel for rank k, NULL if there is none
+inline BatchBPPKernel batchBPPKernel(UWORD k) {
+  struct Table {
+    BatchBPPKernel kernels[BPP_SMALL_MAX_K + 1];
+    Table() {
+      for (int i = 0; i <= BPP_SMALL_MAX_K; i++) kernels[i] = NULL;
+      BatchBPPTable<BPP_SMALL_MAX_K>::fill(kernels);
+    }
+  };
+  static const Table table;
+  return k <= BPP_SMALL_MAX_K ? table.kernels[k] : NULL;
+}
+
+}  // namespace planc
+
+#endif  // DISTNMF_NNLS_BATCH_HPP_
@@ -15,24 +15,87 @@ This file is modified from nnls_bpp.hpp file of Ramakrishna Kannan's Planc libra
 #include <lapacke.h>
 #endif
 #include <assert.h>
-#include "ActiveSetNNLS.h"
+#include <omp.h>
 #include "../planc-master/nnls/nnls.hpp"
 #include "../planc-master/common/utils.hpp"
 #include <set>
 #include <algorithm>
 #include <iomanip>
-#include "ActiveSetNNLS.hpp"
-#include "../planc-master/nnls/SortBooleanMatrix.hpp"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "nnls_activeset.hpp"
 
 template <class MATTYPE, class VECTYPE>
 class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
   public:
     BPPNNLS(MATTYPE input, VECTYPE rhs, bool prodSent = false):
-        NNLS<MATTYPE, VECTYPE>(input, rhs, prodSent) {
+        NNLS<MATTYPE, VECTYPE>(input, rhs, prodSent), m_passive(NULL),
+        m_fallbacks(0) {
     }
     BPPNNLS(MATTYPE input, MATTYPE RHS, bool prodSent = false) :
-        NNLS<MATTYPE, VECTYPE>(input, RHS, prodSent) {
+        NNLS<MATTYPE, VECTYPE>(input, RHS, prodSent), m_passive(NULL),
+        m_fallbacks(0) {
     }
+    /**
+     * Solver without a problem, for repeated solveNNLS(AtA, AtB) calls
+     * that keep reusing its memory.
+     */
+    BPPNNLS() : NNLS<MATTYPE, VECTYPE>(MATTYPE(), MATTYPE(), true),
+        m_passive(NULL), m_fallbacks(0) {
+    }
+    /**
+     * Solves AtA X = AtB with X >= 0 on a reused solver. AtA and AtB are
+     * read in place instead of being copied and must not change during
+     * the call. The solution keeps its memory when the size repeats.
+     * @param[in,out] passive optional n x k mask of the passive set every
+     *                column starts from, e.g. the one of the previous outer
+     *                iteration. All zeros is the cold start. Overwritten
+     *                with the positive entries of the solution.
+     * @return number of iterations
+     */
+    int solveNNLS(const MATTYPE &AtA, const MATTYPE &AtB,
+                  arma::umat *passive = NULL) {
+        alias(AtA, &this->AtA);
+        this->n = AtB.n_rows;
+        this->k = AtB.n_cols;
+        if (this->k == 1) {
+            alias(AtB, &this->Atb);
+            this->x.zeros(this->n);
+        } else {
+            alias(AtB, &this->AtB);
+            this->X.zeros(this->n, this->k);
+        }
+        this->cleared = false;
+        m_passive = passive;
+        int iterations = solveNNLS();
+        if (m_passive != NULL) {
+            if (this->k == 1) {
+                *m_passive = this->x > 0;
+            } else {
+                *m_passive = this->X > 0;
+            }
+            m_passive = NULL;
+        }
+        return iterations;
+    }
+    /**
+     * Writes the transposed solution of the last solve into the rows
+     * first, ..., first + k - 1 of out.
+     */
+    void solutionToRows(UWORD first, MATTYPE *out) const {
+        if (this->k == 1) {
+            out->row(first) = this->x.t();
+        } else {
+            out->rows(first, first + this->k - 1) = this->X.t();
+        }
+    }
+    /**
+     * Right hand sides that BPP did not solve in its iteration limit and
+     * that went to the active set method, since the last clearFallbacks.
+     */
+    UWORD fallbacks() const { return m_fallbacks; }
+    void clearFallbacks() { m_fallbacks = 0; }
     int solveNNLS() {
         int rcIterations = 0;
         if (this->k == 1) {
@@ -46,6 +109,37 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
         return rcIterations;
     }
   private:
+    arma::umat *m_passive;  /// initial passive set of solveNNLS, or NULL
+    UWORD m_fallbacks;
+    // active set solvers of the fallback, one per thread, and the columns
+    // they solve
+    std::vector<GramActiveSetNNLS> m_fallback;
+    std::vector<UINT> m_fallbackCols;
+
+    // Cholesky factors of the passive sets met during one solve, keyed by
+    // the bit mask of the set. AtA changes between solves, so every solve
+    // starts with an empty cache.
+    struct CholFactor {
+        UVEC idx;     /// indices of the passive set
+        MATTYPE R;    /// upper Cholesky factor of AtA(idx, idx)
+        int info;     /// potrf result, nonzero if not positive definite
+    };
+    typedef std::unordered_map<std::string, CholFactor> FactorMap;
+    typedef std::unordered_map<std::string, std::vector<UINT> > GroupMap;
+    FactorMap m_factors;
+    GroupMap m_groups;   /// columns of every passive set, reused
+
+    /// turns dst into a non owning view of src
+    static void alias(const MATTYPE &src, MATTYPE *dst) {
+        MATTYPE view(const_cast<typename MATTYPE::elem_type *>(src.memptr()),
+                     src.n_rows, src.n_cols, false, false);
+        dst->steal_mem(view);
+    }
+    static void alias(const MATTYPE &src, VECTYPE *dst) {
+        VECTYPE view(const_cast<typename MATTYPE::elem_type *>(src.memptr()),
+                     src.n_elem, false, false);
+        dst->steal_mem(view);
+    }
     /*
      * This implementation is based on Algorithm 1 on Page 6 of paper
      * http://www.cc.gatech.edu/~hpark/papers/SISC_082117RR_Kim_Park.pdf.
@@ -64,6 +158,20 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
             allIdxs.push_back(i);
         }
         VECTYPE y = -this->Atb;
+        if (m_passive != NULL) {
+            // warm start from the given passive set
+            F = find(m_passive->col(0) != 0);
+            G = find(m_passive->col(0) == 0);
+            if (!F.empty()) {
+                this->x(F) = solveSymmetricLinearEquations(this->AtA(F, F),
+                             this->Atb.rows(F));
+                y = (this->AtA * this->x) - this->Atb;
+                y(F).zeros();
+                fixAbsNumericalError<VECTYPE>(&this->x, EPSILON_1EMINUS12,
+                                              0.0);
+                fixAbsNumericalError<VECTYPE>(&y, EPSILON_1EMINUS12, 0.0);
+            }
+        }
 #ifdef _VERBOSE
         INFO << std::endl <<  "C : " << this->AtA;
         INFO << "b : " << this->Atb;
@@ -148,8 +256,8 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
 #endif
             this->x(G).zeros();
             y(F).zeros();
-            fixNumericalError<VECTYPE>(&this->x);
-            fixNumericalError<VECTYPE>(&y);
+            fixAbsNumericalError<VECTYPE>(&this->x, EPSILON_1EMINUS12, 0.0);
+            fixAbsNumericalError<VECTYPE>(&y, EPSILON_1EMINUS12, 0.0);
             // according to lawson and hanson if for alpha==0, the computed
             // x at V is negative, it is because of the numerical error of
             // y at V being negative. Set it to zero.
@@ -164,19 +272,11 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
             numIterations++;
         }
         if (numIterations >= MAX_ITERATIONS && !solutionFound) {
-            ERR << "max iterations passed. calling Hanson's ActivesetNNLS"
-                << std::endl;
-            ERR << "current x initialized for Hanson's algo : " <<  std::endl
-                << this->x;
-            ActiveSetNNLS<double> anls(this->n, this->n);
-            double rNorm;
-            anls.solve(this->AtA.memptr(), static_cast<int>(this->n),
-                       this->Atb.memptr(), this->x.memptr(), rNorm);
-            double *nnlsDual = anls.getDual();
-            INFO << "Activeset NNLS Dual:" << std::endl;
-            for (int i = 0; i < this->n; i++) {
-                INFO << nnlsDual[i] << std::endl;
-            }
+            // continue from the last BPP iterate with the active set method
+            if (m_fallback.empty()) m_fallback.resize(1);
+            m_fallback[0].solve(this->AtA.memptr(), this->n,
+                                this->Atb.memptr(), this->x.memptr());
+            m_fallbacks++;
         }
         return numIterations;
     }
@@ -186,11 +286,11 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
      */
 
     int solveNNLSMultipleRHS() {
+        m_factors.clear();
         UINT currentIteration = 0;
         UINT MAX_ITERATIONS = this->n * 2;
         MATTYPE Y = -this->AtB;
-        UVEC Fv(this->n * this->k);
-        Fv.zeros();
+        UVEC Fv;
         UVEC Gv(this->n * this->k);
         arma::umat V(this->n, this->k);
         STDVEC allIdxs;
@@ -200,6 +300,22 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
             Gv(i) = i;
             allIdxs.push_back(i);
         }
+        if (m_passive != NULL) {
+            // warm start from the given passive sets
+            Fv = find(*m_passive != 0);
+            Gv = find(*m_passive == 0);
+            if (!Fv.empty()) {
+                UVEC FvCols = find(sum(*m_passive) != 0);
+                this->X.cols(FvCols) = solveNormalEqComb(this->AtA,
+                                       this->AtB.cols(FvCols),
+                                       m_passive->cols(FvCols));
+                Y = (this->AtA * this->X) - this->AtB;
+                Y(Fv).zeros();
+                fixAbsNumericalError<MATTYPE>(&this->X, EPSILON_1EMINUS12,
+                                              0.0);
+                fixAbsNumericalError<MATTYPE>(&Y, EPSILON_1EMINUS12, 0.0);
+            }
+        }
         UVEC alpha(this->k), beta(this->k);
         alpha.ones();
         alpha = alpha * 3;
@@ -216,16 +332,10 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
         INFO << "Condition : " << cond(this->AtA) << std::endl;
 #endif
         while (currentIteration < MAX_ITERATIONS) {
-            UVEC V1 = find(this->X(Fv) < 0);
+            // find on an empty Fv gave an error
+            UVEC V1;
+            if (!Fv.empty()) V1 = find(this->X(Fv) < 0);
             UVEC V2 = find(Y(Gv) < 0);
-            // Fv was initialized to zeros because the find during
-            // first iteration with empty Fv gave an error.
-            // However, zero Fv was giving wrong Gv during fixAllSets.
-            // Hence clearing Fv as the zero Idx really does not
-            // belong to Fv in the initialization.
-            if (currentIteration == 0) {
-                Fv.clear();
-            }
 #ifdef _VERBOSE
             INFO << "X(Fv)<0 : " << V1.size() << std::endl <<  V1;
             INFO << "Y(Gv)<0 : " << V2.size() << std::endl << V2;
@@ -327,8 +437,11 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
                                    PassiveSet.cols(FvCols));
             Y.cols(FvCols) = (this->AtA * this->X.cols(FvCols))
                              - this->AtB.cols(FvCols);
-            fixNumericalError<MATTYPE>(&this->X);
-            fixNumericalError<MATTYPE>(&Y);
+            // a column whose passive set became empty has X = 0
+            UVEC GvCols = find(sum(PassiveSet) == 0);
+            Y.cols(GvCols) = -this->AtB.cols(GvCols);
+            fixAbsNumericalError<MATTYPE>(&this->X, EPSILON_1EMINUS12, 0.0);
+            fixAbsNumericalError<MATTYPE>(&Y, EPSILON_1EMINUS12, 0.0);
             // according to lawson and hanson if for alpha==0, the computed
             // x at V is negative, it is because of the numerical error of
             // y at V being negative. Set it to zero.
@@ -350,8 +463,8 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
             currentIteration++;
         }
         if (currentIteration >= MAX_ITERATIONS && !solutionFound) {
-            ERR << "something wrong. appears to be infeasible" << std::endl;
 #ifdef _VERBOSE
+            ERR << "something wrong. appears to be infeasible" << std::endl;
             INFO << "X : " << this->X.n_rows << "x" << this->X.n_cols
                  << " AtB:" << this->AtB.n_rows << "x" << this->AtB.n_cols
                  << " AtA" << this->AtA.n_rows << "x" << this->AtA.n_cols
@@ -368,101 +481,105 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
             sleep(60);
             exit(EXIT_FAILURE);
 #endif
-            INFO << "calling classical activeset" << std::endl;
-            for (UINT i = 0; i < this->k; i++) {
-                UVEC V1 = find(this->X.col(i) < 0);
-                UVEC V2 = find(Y.col(i) < 0);
-                if (!V1.empty() || !V2.empty()) {
-#ifdef _VERBOSE
-                    WARN << "col " << i << " not optimal " << std::endl;
-                    WARN << "current x initialized for Hanson's algo : "
-                         <<  std::endl << this->X.col(i);
-#endif
-                    ActiveSetNNLS<double> anls(this->n, this->n);
-                    double rNorm;
-                    double *currentX = new double[this->n];
-                    double *currentRHS = new double[this->n];
-                    for (UINT j = 0; j < this->n; j++) {
-                        currentX[j] = this->X(j, i);
-                        currentRHS[j] = this->AtB(j, i);
-                    }
-                    anls.solve(this->AtA.memptr(), static_cast<int>(this->n),
-                               currentRHS, currentX, rNorm);
-                    for (UINT j = 0; j < this->n; j++) {
-                        this->X(j, i) = currentX[j];
-                    }
-                }
-            }
+            solveFallback(Y);
         }
         return currentIteration;
     }
+    /*
+     * Solves the columns that are not optimal after the BPP iterations
+     * with the active set method, starting from the last BPP iterate.
+     * The columns are spread over the threads unless the solve already
+     * runs in a parallel region.
+     */
+    void solveFallback(const MATTYPE &Y) {
+        m_fallbackCols.clear();
+        for (UINT i = 0; i < this->k; i++) {
+            if (any(this->X.col(i) < 0) || any(Y.col(i) < 0))
+                m_fallbackCols.push_back(i);
+        }
+        if (m_fallbackCols.empty()) return;
+        int numThreads = omp_in_parallel() ? 1 : omp_get_max_threads();
+        numThreads = std::min<int>(numThreads, m_fallbackCols.size());
+        if (m_fallback.size() < static_cast<size_t>(numThreads))
+            m_fallback.resize(numThreads);
+#pragma omp parallel for schedule(dynamic) num_threads(numThreads)
+        for (UINT j = 0; j < m_fallbackCols.size(); j++) {
+            UINT i = m_fallbackCols[j];
+            m_fallback[omp_get_thread_num()].solve(this->AtA.memptr(),
+                    this->n, this->AtB.colptr(i), this->X.colptr(i));
+        }
+        m_fallbacks += m_fallbackCols.size();
+    }
     /*
      * This function to support the step 10 of the algorithm 2.
      * This is implementation of the paper
      * Fast algorithm for the solution of large-scale non-negativity-constrained least squares problems
      * M. H. Van Benthem and M. R. Keenan, J. Chemometrics 2004; 18: 441-450
-     * Motivated out of implementation from Jingu's solveNormalEqComb.m
+     * Columns with the same passive set are grouped through a hash of the
+     * set's bit mask. The Cholesky factor of AtA(F, F) of every set is
+     * computed once with potrf and kept in m_factors for the remaining
+     * pivoting iterations, and the columns of a group are solved with one
+     * potrs.
      */
-    MATTYPE solveNormalEqComb(MATTYPE AtA, MATTYPE AtB, arma::umat PassSet) {
-        MATTYPE Z;
-        UVEC Pv = find(PassSet != 0);
-        UVEC anyZeros = find(PassSet == 0);
-        if (anyZeros.empty()) {
-            // Everything is the in the passive set.
-            // INFO << "starting empty activeset solve" << endl;
-            // Z = arma::solve(AtA,AtB);
-            // INFO << "exiting empty activeset solve" << endl;
-            Z = solveSymmetricLinearEquations(AtA, AtB);
-        } else {
-            Z.resize(AtB.n_rows, AtB.n_cols);
-            Z.zeros();
-            UINT k1 = PassSet.n_cols;
-            if (k1 == 1) {
-                // INFO << "entry one col pass set" << endl;
-                // Z(Pv)=arma::solve(AtA(Pv,Pv),AtB(Pv));
-                // INFO << "exit one col pass set" << endl;
-                Z(Pv) = solveSymmetricLinearEquations(AtA(Pv, Pv), AtB(Pv));
+    MATTYPE solveNormalEqComb(const MATTYPE &AtA, const MATTYPE &AtB,
+                              const arma::umat &PassSet) {
+        MATTYPE Z(AtB.n_rows, AtB.n_cols);
+        Z.zeros();
+        m_groups.clear();
+        std::string key;
+        for (UINT j = 0; j < PassSet.n_cols; j++) {
+            maskKey(PassSet.colptr(j), PassSet.n_rows, &key);
+            m_groups[key].push_back(j);
+        }
+        for (typename GroupMap::iterator it = m_groups.begin();
+             it != m_groups.end(); ++it) {
+            const CholFactor &f = factor(AtA, it->first,
+                                         PassSet.colptr(it->second[0]));
+            if (f.idx.empty()) continue;
+            UVEC cols = arma::conv_to<UVEC>::from(it->second);
+            MATTYPE B = AtB(f.idx, cols);
+            if (f.info == 0) {
+                LAPACKE_dpotrs(LAPACK_COL_MAJOR, 'U', f.R.n_rows, B.n_cols,
+                               f.R.memptr(), f.R.n_rows, B.memptr(),
+                               B.n_rows);
             } else {
-                // we have to group passive set columns that are same.
-                // find the correlation matrix of passive set matrix.
-                std::vector<UWORD> sortedIdx, beginIdx;
-                computeCorrelationScore(PassSet, sortedIdx, beginIdx);
-                // UVEC solved(k1);
-                // solved.zeros();
-                // assert(corrPassMat.n_rows==PassSet.n_cols);
-                // assert(corrPassMat.n_cols==PassSet.n_cols);
-                for (UINT i = 1; i < beginIdx.size(); i++) {
-                    // if(!solved(i))
-                    // {
-                    // UVEC samePassiveSetCols=find(corrPassMat.col(i)==1);
-                    UWORD sortedBeginIdx = beginIdx[i - 1];
-                    UWORD sortedEndIdx = beginIdx[i];
-                    UVEC samePassiveSetCols(std::vector<UWORD>
-                                            (sortedIdx.begin() + sortedBeginIdx,
-                                             sortedIdx.begin() + sortedEndIdx));
-                    // solved(samePassiveSetCols).ones();
-                    UVEC currentPassiveSet = find(PassSet.col( sortedIdx[sortedBeginIdx] ) == 1);
+                // AtA(F, F) is not positive definite
+                B = arma::solve(AtA(f.idx, f.idx), B);
+            }
 #ifdef _VERBOSE
-                    INFO << "samePassiveSetCols:" << std::endl
-                         <<  samePassiveSetCols;
-                    INFO << "currPassiveSet : " << std::endl
-                         << currentPassiveSet;
-                    INFO << "AtA:" << std::endl
-                         << AtA(currentPassiveSet, currentPassiveSet);
-                    INFO << "AtB:" << std::endl
-                         << AtB(currentPassiveSet, samePassiveSetCols);
+            INFO << "samePassiveSetCols:" << std::endl << cols;
+            INFO << "currPassiveSet : " << std::endl << f.idx;
 #endif
-                    Z(currentPassiveSet, samePassiveSetCols) =
-                        solveSymmetricLinearEquations(AtA(currentPassiveSet, currentPassiveSet),
-                                                      AtB(currentPassiveSet, samePassiveSetCols));
-                }
-            }
+            Z(f.idx, cols) = B;
         }
 #ifdef _VERBOSE
         INFO << "Returning mat Z:" << std::endl << Z;
 #endif
         return Z;
     }
+    /// packs the n entries of a passive set column into bytes
+    static void maskKey(const arma::uword *col, UINT n, std::string *key) {
+        key->assign((n + 7) / 8, '\0');
+        for (UINT i = 0; i < n; i++) {
+            if (col[i]) (*key)[i / 8] |= static_cast<char>(1 << (i % 8));
+        }
+    }
+    /// Cholesky factor of AtA(F, F) for the passive set F with that key
+    const CholFactor &factor(const MATTYPE &AtA, const std::string &key,
+                             const arma::uword *col) {
+        typename FactorMap::iterator it = m_factors.find(key);
+        if (it != m_factors.end()) return it->second;
+        CholFactor &f = m_factors[key];
+        f.idx = find(arma::uvec(const_cast<arma::uword *>(col), AtA.n_rows,
+                                false, true) != 0);
+        f.info = 0;
+        if (!f.idx.empty()) {
+            f.R = AtA(f.idx, f.idx);
+            f.info = LAPACKE_dpotrf(LAPACK_COL_MAJOR, 'U', f.R.n_rows,
+                                    f.R.memptr(), f.R.n_rows);
+        }
+        return f;
+    }
     /*
      * This constructs the sets F, G and V based on
      * equation 3.5a and 3.5b. This is also the
@@ -534,27 +651,6 @@ class BPPNNLS : public NNLS<MATTYPE, VECTYPE> {
         }
         return B;
     }
-    /*
-    * Passset is a binary matrix where every column represents
-    * one datapoint. The objective is to returns a low triangular
-    * correlation matrix with 1 if the strings are equal. Zero otherwise
-    */
-    void computeCorrelationScore(arma::umat &PassSet, std::vector<UWORD> &sortedIdx,
-                                 std::vector<UWORD> &beginIndex) {
-        SortBooleanMatrix<arma::umat> sbm(PassSet);
-        sortedIdx = sbm.sortIndex();
-        BooleanArrayComparator<arma::umat> bac(PassSet);
-        uint beginIdx = 0;
-        beginIndex.clear();
-        beginIndex.push_back(beginIdx);
-        for (uint i = 0; i < sortedIdx.size(); i++) {
-            if (i == sortedIdx.size() - 1 || bac(sortedIdx[i], sortedIdx[i + 1]) == true) {
-                beginIdx = i + 1;
-                beginIndex.push_back(beginIdx);
-            }
-        }
-    }
-
     /*
     * Given a matrix, the last column of the matrix will be
     * checked if it reappears again. Every column in the matrix
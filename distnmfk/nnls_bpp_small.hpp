@@ -0,0 +1,174 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file holds the block principal pivoting NNLS kernels specialized on the rank k.
+*/
+
+#ifndef DISTNMF_NNLS_BPP_SMALL_HPP_
+#define DISTNMF_NNLS_BPP_SMALL_HPP_
+
+#include <stdint.h>
+#include <cmath>
+#include "../planc-master/common/utils.h"
+
+namespace planc {
+
+/// largest rank with a specialized kernel, the passive set is one word
+#define BPP_SMALL_MAX_K 64
+
+/**
+ * Solves AtA x = b, x >= 0 for one right hand side of a rank k known at
+ * compile time. Same pivoting rules as BPPNNLS, Algorithm 2 of Kim and
+ * Park, but AtA, the passive set and the iterates live in fixed size stack
+ * arrays, the passive set F as a bit mask, and nothing is allocated in the
+ * pivot loop. The products with AtA run over the constant k so that the
+ * compiler unrolls and vectorizes them. The Cholesky factor of AtA(F, F)
+ * is computed in place in a k x k array.
+ * @tparam K rank, 2 <= K <= BPP_SMALL_MAX_K
+ */
+template <int K>
+class SmallBPP {
+ private:
+  static bool in(uint64_t set, int i) { return (set >> i) & 1; }
+
+  /**
+   * x(F) = AtA(F, F) \ b(F), x(G) = 0, y = AtA x - b on G and 0 on F,
+   * with the entries below 1e-12 in magnitude set to zero.
+   * @return false if AtA(F, F) is not positive definite
+   */
+  static bool solvePassive(const double *AtA, const double *b, uint64_t F,
+                           double *x, double *y) {
+    int idx[K];
+    int nf = 0;
+    for (int i = 0; i < K; i++)
+      if (in(F, i)) idx[nf++] = i;
+    // lower Cholesky factor of AtA(F, F), column major with leading dim K
+    double L[K * K];
+    double z[K];
+    for (int j = 0; j < nf; j++) {
+      for (int i = j; i < nf; i++) L[j * K + i] = AtA[idx[j] * K + idx[i]];
+      z[j] = b[idx[j]];
+    }
+    for (int j = 0; j < nf; j++) {
+      for (int p = 0; p < j; p++) {
+        double ljp = L[p * K + j];
+        for (int i = j; i < nf; i++) L[j * K + i] -= L[p * K + i] * ljp;
+      }
+      if (!(L[j * K + j] > 0)) return false;
+      double d = std::sqrt(L[j * K + j]);
+      for (int i = j; i < nf; i++) L[j * K + i] /= d;
+    }
+    for (int j = 0; j < nf; j++) {
+      z[j] /= L[j * K + j];
+      for (int i = j + 1; i < nf; i++) z[i] -= L[j * K + i] * z[j];
+    }
+    for (int j = nf - 1; j >= 0; j--) {
+      for (int i = j + 1; i < nf; i++) z[j] -= L[j * K + i] * z[i];
+      z[j] /= L[j * K + j];
+    }
+    for (int i = 0; i < K; i++) x[i] = 0;
+    for (int j = 0; j < nf; j++) x[idx[j]] = z[j];
+    for (int i = 0; i < K; i++) y[i] = -b[i];
+    for (int j = 0; j < K; j++) {
+      const double *col = AtA + j * K;
+      double xj = x[j];
+      for (int i = 0; i < K; i++) y[i] += col[i] * xj;
+    }
+    for (int i = 0; i < K; i++) {
+      if (in(F, i)) y[i] = 0;
+      if (std::abs(x[i]) < EPSILON_1EMINUS12) x[i] = 0;
+      if (std::abs(y[i]) < EPSILON_1EMINUS12) y[i] = 0;
+    }
+    return true;
+  }
+
+ public:
+  /**
+   * @param[in] AtA K x K column major gram matrix
+   * @param[in] b right hand side of length K
+   * @param[out] x solution of length K
+   * @param[in,out] passive 0/1 passive set of length K the pivoting starts
+   *                from, replaced by x > 0 on success
+   * @return false if the pivoting did not converge in 2K steps or AtA(F, F)
+   *         was singular. passive is left unchanged, the caller solves
+   *         the column with the general solver.
+   */
+  static bool solve(const double *AtA, const double *b, double *x,
+                    UWORD *passive) {
+    double y[K];
+    uint64_t F = 0;
+    for (int i = 0; i < K; i++)
+      if (passive[i] != 0) F |= uint64_t(1) << i;
+    if (F == 0) {
+      for (int i = 0; i < K; i++) {
+        x[i] = 0;
+        y[i] = -b[i];
+      }
+    } else if (!solvePassive(AtA, b, F, x, y)) {
+      return false;
+    }
+    int alpha = 3;
+    int beta = K + 1;
+    for (int it = 0; it < 2 * K; it++) {
+      uint64_t V = 0;
+      for (int i = 0; i < K; i++)
+        if (in(F, i) ? x[i] < 0 : y[i] < 0) V |= uint64_t(1) << i;
+      if (V == 0) {
+        for (int i = 0; i < K; i++) passive[i] = x[i] > 0;
+        return true;
+      }
+      int numv = __builtin_popcountll(V);
+      int single = -1;
+      if (numv < beta) {
+        beta = numv;
+        alpha = 3;
+      } else if (alpha >= 1) {
+        alpha--;
+      } else {
+        single = 63 - __builtin_clzll(V);
+        V = uint64_t(1) << single;
+      }
+      F ^= V;
+      if (!solvePassive(AtA, b, F, x, y)) return false;
+      // Lawson and Hanson's fix, see BPPNNLS
+      if (single >= 0 && x[single] < 0) {
+        x[single] = 0;
+        y[single] = 0;
+      }
+    }
+    return false;
+  }
+};
+
+typedef bool (*SmallBPPKernel)(const double *, const double *, double *,
+                               UWORD *);
+
+template <int K>
+struct SmallBPPTable {
+  static void fill(SmallBPPKernel *table) {
+    table[K] = &SmallBPP<K>::solve;
+    SmallBPPTable<K - 1>::fill(table);
+  }
+};
+template <>
+struct SmallBPPTable<1> {
+  static void fill(SmallBPPKernel *) {}
+};
+
+/// kernel specialized on rank k, NULL if there is none
+inline SmallBPPKernel smallBPPKernel(UWORD k) {
+  struct Table {
+    SmallBPPKernel kernels[BPP_SMALL_MAX_K + 1];
+    Table() {
+      for (int i = 0; i <= BPP_SMALL_MAX_K; i++) kernels[i] = NULL;
+      SmallBPPTable<BPP_SMALL_MAX_K>::fill(kernels);
+    }
+  };
+  static const Table table;
+  return k <= BPP_SMALL_MAX_K ? table.kernels[k] : NULL;
+}
+
+}  // namespace planc
+
+#endif  // DISTNMF_NNLS_BPP_SMALL_HPP_
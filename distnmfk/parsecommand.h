@@ -25,6 +25,24 @@ This file is modified from parsecommandline.h file of Ramakrishnan Kannan's Plan
 #define NUMKBLOCKS 2004
 #define NORMALIZATION 2005
 #define DIMTREE 2006
+#define AUTOGRID 2007
+#define MEMLIMIT 2008
+#define OUTPUTFORMAT 2009
+#define SAVERUNS 2010
+#define NOISE 2011
+#define COLSKEW 2012
+#define PLANTEDK 2013
+#define TRUTH 2014
+#define OVERLAP 2015
+#define TIMETRACE 2016
+#define CHROMETRACE 2017
+#define NODEGATHER 2018
+#define ERRCHECK 2019
+#define INNERITER 2020
+#define INNERTOL 2021
+#define INNERSOLVER 2022
+#define ADMMITER 2023
+#define ADMMTOL 2024
 
 // enum factorizationtype{FT_NMF, FT_DISTNMF, FT_NTF, FT_DISTNTF};
 
@@ -107,6 +125,24 @@ struct option nmfkopts[] = {
     {"numkblocks", optional_argument, 0, NUMKBLOCKS},
     {"normalization", optional_argument, 0, NORMALIZATION},
     {"dimtree", optional_argument, 0, DIMTREE},
+    {"autogrid", optional_argument, 0, AUTOGRID},
+    {"memlimit", optional_argument, 0, MEMLIMIT},
+    {"outputformat", optional_argument, 0, OUTPUTFORMAT},
+    {"saveruns", optional_argument, 0, SAVERUNS},
+    {"noise", optional_argument, 0, NOISE},
+    {"colskew", optional_argument, 0, COLSKEW},
+    {"plantedk", optional_argument, 0, PLANTEDK},
+    {"truth", optional_argument, 0, TRUTH},
+    {"overlap", optional_argument, 0, OVERLAP},
+    {"timetrace", optional_argument, 0, TIMETRACE},
+    {"chrometrace", optional_argument, 0, CHROMETRACE},
+    {"nodegather", optional_argument, 0, NODEGATHER},
+    {"errcheck", optional_argument, 0, ERRCHECK},
+    {"inneriter", optional_argument, 0, INNERITER},
+    {"innertol", optional_argument, 0, INNERTOL},
+    {"innersolver", optional_argument, 0, INNERSOLVER},
+    {"admmiter", optional_argument, 0, ADMMITER},
+    {"admmtol", optional_argument, 0, ADMMTOL},
     {0, 0, 0, 0}};
 
 #endif  // COMMON_PARSECOMMANDLINE_H_
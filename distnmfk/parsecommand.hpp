@@ -28,7 +28,28 @@ class ParseCommandLine {
   //double objective_err;
   int m_num_it;
   int m_num_k_blocks;
+  bool m_num_k_blocks_given;
   bool m_dim_tree;
+  bool m_autogrid;
+  double m_memlimit;
+  bool m_binary_output;
+  bool m_save_runs;
+  bool m_overlap;
+  bool m_nodegather;
+  int m_errcheck;
+  int m_inneriter;
+  double m_innertol;
+  algotype m_innersolver;
+  int m_admmiter;
+  double m_admmtol;
+
+  // rand_planted generator
+  double m_noise;
+  double m_colskew;
+  UWORD m_planted_k;
+  std::string m_truth_file_name;
+  std::string m_timetrace_prefix;
+  std::string m_chrometrace_file;
 
   // file names
   std::string m_Afile_name;
@@ -107,12 +128,29 @@ class ParseCommandLine {
     this->m_regW = arma::zeros<FVEC>(2);
     this->m_regH = arma::zeros<FVEC>(2);
     this->m_num_k_blocks = 1;
+    this->m_num_k_blocks_given = false;
     this->m_k = 20;
     this->m_num_it = 20;
     this->m_lucalgo = ANLSBPP;
     this->m_compute_error = 0;
     this->m_input_normalization = NONE;
     this->m_dim_tree = 1;
+    this->m_autogrid = 0;
+    this->m_memlimit = 0;
+    this->m_binary_output = 0;
+    this->m_save_runs = 0;
+    this->m_overlap = 0;
+    this->m_nodegather = 0;
+    this->m_errcheck = 0;
+    this->m_inneriter = 1;
+    this->m_innertol = 0.1;
+    this->m_innersolver = ANLSBPP;
+    this->m_admmiter = 5;
+    this->m_admmtol = 0.01;
+    this->m_sparsity = 1;
+    this->m_noise = 0;
+    this->m_colskew = 0;
+    this->m_planted_k = 0;
    // this->objective_err = 0;
   }
   /// parses the command line parameters
@@ -154,6 +192,7 @@ class ParseCommandLine {
           break;
         case NUMKBLOCKS:
           this->m_num_k_blocks = atoi(optarg);
+          this->m_num_k_blocks_given = true;
           break;
         case NORMALIZATION: {
           std::string temp = std::string(optarg);
@@ -239,6 +278,7 @@ class ParseCommandLine {
         }
         case NUMKBLOCKS:
           this->m_num_k_blocks = atoi(optarg);
+          this->m_num_k_blocks_given = true;
           break;
         case NORMALIZATION: {
           std::string temp = std::string(optarg);
@@ -252,6 +292,68 @@ class ParseCommandLine {
         case DIMTREE:
           this->m_dim_tree = atoi(optarg);
           break;
+        case AUTOGRID:
+          this->m_autogrid = atoi(optarg);
+          break;
+        case MEMLIMIT:
+          this->m_memlimit = atof(optarg);
+          break;
+        case OUTPUTFORMAT: {
+          std::string temp = std::string(optarg);
+          this->m_binary_output = (temp.compare("binary") == 0);
+          break;
+        }
+        case SAVERUNS:
+          this->m_save_runs = atoi(optarg);
+          break;
+        case NOISE:
+          this->m_noise = atof(optarg);
+          break;
+        case COLSKEW:
+          this->m_colskew = atof(optarg);
+          break;
+        case PLANTEDK:
+          this->m_planted_k = atoi(optarg);
+          break;
+        case TRUTH:
+          this->m_truth_file_name = std::string(optarg);
+          break;
+        case OVERLAP:
+          this->m_overlap = atoi(optarg);
+          break;
+        case NODEGATHER:
+          this->m_nodegather = atoi(optarg);
+          break;
+        case ERRCHECK:
+          this->m_errcheck = atoi(optarg);
+          break;
+        case INNERITER:
+          this->m_inneriter = atoi(optarg);
+          break;
+        case INNERTOL:
+          this->m_innertol = atof(optarg);
+          break;
+        case INNERSOLVER:
+          this->m_innersolver = static_cast<algotype>(atoi(optarg));
+          if (this->m_innersolver != HALS && this->m_innersolver != ANLSBPP) {
+            std::cout << "innersolver must be 1 (HALS) or 2 (ANLSBPP):"
+                      << optarg << std::endl;
+            print_usage();
+            exit(EXIT_FAILURE);
+          }
+          break;
+        case ADMMITER:
+          this->m_admmiter = atoi(optarg);
+          break;
+        case ADMMTOL:
+          this->m_admmtol = atof(optarg);
+          break;
+        case TIMETRACE:
+          this->m_timetrace_prefix = std::string(optarg);
+          break;
+        case CHROMETRACE:
+          this->m_chrometrace_file = std::string(optarg);
+          break;
         default:
           std::cout << "failed while processing argument:" << optarg
                     << std::endl;
@@ -308,7 +410,24 @@ class ParseCommandLine {
               << "::perturbs::" <<this->m_perturbs
               << "::outputsilhouettes::" <<this->m_output_silhouettes
               << "::input normalization::" << this->m_input_normalization
-              << "::dimtree::" << this->m_dim_tree << std::endl;
+              << "::dimtree::" << this->m_dim_tree
+              << "::autogrid::" << this->m_autogrid
+              << "::memlimit::" << this->m_memlimit
+              << "::binaryoutput::" << this->m_binary_output
+              << "::saveruns::" << this->m_save_runs
+              << "::noise::" << this->m_noise
+              << "::colskew::" << this->m_colskew
+              << "::plantedk::" << this->m_planted_k
+              << "::overlap::" << this->m_overlap
+              << "::nodegather::" << this->m_nodegather
+              << "::errcheck::" << this->m_errcheck
+              << "::inneriter::" << this->m_inneriter
+              << "::innertol::" << this->m_innertol
+              << "::innersolver::" << this->m_innersolver
+              << "::admmiter::" << this->m_admmiter
+              << "::admmtol::" << this->m_admmtol
+              << "::timetrace::" << this->m_timetrace_prefix
+              << "::chrometrace::" << this->m_chrometrace_file << std::endl;
   }
 
   void print_usage() {
@@ -318,7 +437,8 @@ class ParseCommandLine {
          << std::endl
          << "for long arguments like --pr give key=value pair, eg --pr=4"
          << std::endl
-         << "algorithm codes 0-MU2D, 1-HALS2D, 2-ANLSBPP2D, 3-NAIVEANLSBPP"
+         << "algorithm codes 0-MU2D, 1-HALS2D, 2-ANLSBPP2D, 3-NAIVEANLSBPP, "
+         << "4-AOADMM2D, 5-NESTEROV2D"
          << std::endl;
     // mpirun -np 12 distnmf algotype lowrank m n numIteration pr pc
     INFO << "Usage 1: mpirun -np 6 distnmf -a 0/1/2/3 -k 50"
@@ -340,6 +460,10 @@ class ParseCommandLine {
     INFO << "Usage 4: mpirun -np 6 distnmf -a 0/1/2/3 -k 50 --dimtree 1"
          << "-i Ainput -o nmfoutput -t 10 -p \"3 2\" --sparsity=0.3"
          << "-r \"0.0001 0 0 0.0001\" " << std::endl;
+    // mpirun -np 12 distnmfk with the grid chosen by the cost model
+    INFO << "Usage 5: mpirun -np 6 distnmfk -a 0/1/2 -k 2 -u 10 -l 10 "
+         << "-i rand_uniform -d \"21600 14400\" -t 10 "
+         << "--autogrid=1 --memlimit=4" << std::endl;
   }
   /// returns the low rank. Passed as parameter --lowrank or -k
   UWORD lowrankk() { return m_k; }
@@ -380,6 +504,8 @@ class ParseCommandLine {
    */
   UVEC dimensions() { return m_dimensions; }
   int num_k_blocks() { return m_num_k_blocks; }
+  /// Whether --numkblocks was passed, --autogrid keeps it then
+  bool num_k_blocks_given() { return m_num_k_blocks_given; }
   /// Returns number of iterations. passed as -t or --iter
   int iterations() { return m_num_it; }
   /// Input parameter for generating sparse matrix. Passed as -s or --sparsity
@@ -422,6 +548,82 @@ class ParseCommandLine {
    * for more than three modes. Passed as parameter --dimtree 1
    */
   bool dim_tree() { return m_dim_tree; }
+  /**
+   * Choose pr, pc and, unless --numkblocks is given, num_k_blocks of
+   * every k from the cost model in distgrid.hpp instead of -p. Passed as
+   * parameter --autogrid 1
+   */
+  bool autogrid() { return m_autogrid; }
+  /**
+   * Per process memory budget in GiB. --autogrid drops the grids that
+   * exceed it and picks num_k_blocks of every k to fit it. 0 means
+   * unlimited. Passed as parameter --memlimit
+   */
+  double memlimit() { return m_memlimit; }
+  /**
+   * Write the factors with collective MPI-IO into one binary file per
+   * factor and k instead of one text file per process.
+   * Passed as parameter --outputformat=binary. Default is ascii.
+   */
+  bool binary_output() { return m_binary_output; }
+  /// Also write the factors of every perturbation. Passed as --saveruns 1
+  bool save_runs() { return m_save_runs; }
+  /// Relative gaussian noise of rand_planted. Passed as --noise
+  double noise() { return m_noise; }
+  /// Log-normal spread of the column norms of rand_planted. Passed as --colskew
+  double colskew() { return m_colskew; }
+  /// Planted rank of rand_planted, -k when 0. Passed as --plantedk
+  UWORD planted_k() { return m_planted_k; }
+  /// Prefix of the rand_planted ground truth factors. Passed as --truth
+  std::string truth_file_name() { return m_truth_file_name; }
+  /**
+   * Pipeline the k blocks of the 2D matrix multiplies with non blocking
+   * collectives. Only used with num_k_blocks > 1. Passed as --overlap 1
+   */
+  bool overlap() { return m_overlap; }
+  /**
+   * Gather the factor blocks of the 2D matrix multiplies once per node
+   * into MPI-3 shared memory. Passed as --nodegather 1
+   */
+  bool nodegather() { return m_nodegather; }
+  /**
+   * Dense builds evaluate the error with the trace identity. Every
+   * errcheck-th iteration the error is also computed from the explicit
+   * residual and the drift printed. 0 never forms the residual. Ignored
+   * for the k with num_k_blocks > 1. Passed as --errcheck 10
+   */
+  int errcheck() { return m_errcheck; }
+  /**
+   * Maximum number of HALS and MU sweeps over a factor per distributed
+   * product. 1, the default, is the plain algorithm. Passed as --inneriter
+   */
+  int inneriter() { return m_inneriter; }
+  /**
+   * The inner sweeps stop once the change of the factor falls below
+   * innertol times the one of the first sweep. Passed as --innertol 0.1
+   */
+  double innertol() { return m_innertol; }
+  /**
+   * Algorithm whose updates the extrapolation of -a 5 wraps, 1 for HALS
+   * or 2 for ANLS/BPP, the default. Other values are rejected. Passed as
+   * --innersolver 1
+   */
+  algotype innersolver() { return m_innersolver; }
+  /// Maximum ADMM iterations per factor update of -a 4. Passed as --admmiter
+  int admmiter() { return m_admmiter; }
+  /**
+   * The ADMM iterations of -a 4 stop once the primal residual and the
+   * change of the factor fall below admmtol of the norms of the factor
+   * and the dual variable. Passed as --admmtol 0.01
+   */
+  double admmtol() { return m_admmtol; }
+  /**
+   * Prefix of the per iteration timing csv written for every k and
+   * perturbation as prefix_K{k}_Run{run}.csv. Passed as --timetrace
+   */
+  std::string timetrace_prefix() { return m_timetrace_prefix; }
+  /// Chrome trace JSON of the timed regions of all ranks. Passed as --chrometrace
+  std::string chrometrace_file() { return m_chrometrace_file; }
   /// Returns whether to compute error not. Passed as parameter -e or --error
   bool compute_error() { return m_compute_error; }
   //double objective_error() { return objective_err; }
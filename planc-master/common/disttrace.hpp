@@ -0,0 +1,169 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file records the named MPITIC/MPITOC regions of every rank as a Chrome trace.
+*/
+
+#ifndef COMMON_DISTTRACE_HPP_
+#define COMMON_DISTTRACE_HPP_
+
+#include <mpi.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/**
+ * Per rank buffer of complete events. A region timed with MPITIC and
+ * MPITOCTRACE(name, bytes) is stored with the current k, perturbation
+ * and iteration. write() streams the events of all the ranks through root
+ * into one JSON file in the Chrome trace event format that chrome://tracing
+ * and Perfetto load, one process per rank. Recording is off until
+ * enable() and costs one branch per region then.
+ */
+class DistTracer {
+ public:
+  struct Event {
+    char name[40];
+    double ts;     /// microseconds since enable()
+    double dur;    /// microseconds
+    double bytes;  /// bytes communicated in the region, 0 for computation
+    int k, run, iter;
+  };
+
+ private:
+  bool m_enabled;
+  size_t m_capacity;
+  size_t m_dropped;
+  std::chrono::steady_clock::time_point m_start;
+  int m_k, m_run, m_iter;
+  std::vector<Event> m_events;
+
+  DistTracer()
+      : m_enabled(false), m_capacity(0), m_dropped(0), m_k(-1), m_run(-1),
+        m_iter(-1) {}
+
+  static double micros(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::micro>(d).count();
+  }
+
+  void writeEvents(FILE *fp, const Event *events, size_t n, int rank,
+                   bool *first) const {
+    for (size_t i = 0; i < n; i++) {
+      const Event &e = events[i];
+      fprintf(fp,
+              "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,"
+              "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"k\":%d,\"run\":%d,"
+              "\"iter\":%d,\"bytes\":%.0f}}",
+              *first ? "" : ",", e.name, rank, e.ts, e.dur, e.k, e.run,
+              e.iter, e.bytes);
+      *first = false;
+    }
+  }
+
+ public:
+  static DistTracer &instance() {
+    static DistTracer tracer;
+    return tracer;
+  }
+
+  /**
+   * Starts recording. The barrier lines up the time origin of the ranks.
+   * @param[in] capacity events kept per rank, later ones are counted
+   */
+  void enable(MPI_Comm comm, size_t capacity = 1 << 18) {
+    MPI_Barrier(comm);
+    m_start = std::chrono::steady_clock::now();
+    m_capacity = capacity;
+    m_events.reserve(capacity);
+    m_enabled = true;
+  }
+  bool enabled() const { return m_enabled; }
+
+  /// k and perturbation of the following events
+  void context(int k, int run) {
+    m_k = k;
+    m_run = run;
+    m_iter = -1;
+  }
+  /// iteration of the following events, -1 outside of the iterations
+  void iteration(int iter) { m_iter = iter; }
+
+  void record(const char *name, std::chrono::steady_clock::time_point begin,
+              std::chrono::steady_clock::time_point end, double bytes) {
+    if (!m_enabled) return;
+    if (m_events.size() >= m_capacity) {
+      m_dropped++;
+      return;
+    }
+    Event e;
+    strncpy(e.name, name, sizeof(e.name) - 1);
+    e.name[sizeof(e.name) - 1] = '\0';
+    e.ts = micros(begin - m_start);
+    e.dur = micros(end - begin);
+    e.bytes = bytes;
+    e.k = m_k;
+    e.run = m_run;
+    e.iter = m_iter;
+    m_events.push_back(e);
+  }
+
+  /**
+   * Writes the events of all the ranks of comm to file_name. Root receives
+   * and writes one rank at a time, so it never holds more than the events
+   * of two ranks. Collective over comm.
+   */
+  void write(const std::string &file_name, MPI_Comm comm) {
+    if (!m_enabled) return;
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    unsigned long long dropped = m_dropped, totaldropped = 0;
+    MPI_Reduce(&dropped, &totaldropped, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+               comm);
+    const int kTag = 7311;
+    if (rank != 0) {
+      unsigned long long n = m_events.size();
+      MPI_Send(&n, 1, MPI_UNSIGNED_LONG_LONG, 0, kTag, comm);
+      if (n > 0)
+        MPI_Send(m_events.data(), n * sizeof(Event), MPI_BYTE, 0, kTag, comm);
+    } else {
+      FILE *fp = fopen(file_name.c_str(), "w");
+      if (fp == NULL) {
+        fprintf(stderr, "could not open the trace file %s\n",
+                file_name.c_str());
+      } else {
+        fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+      }
+      bool first = true;
+      if (fp != NULL) writeEvents(fp, m_events.data(), m_events.size(), 0,
+                                  &first);
+      std::vector<Event> remote;
+      for (int r = 1; r < size; r++) {
+        unsigned long long n;
+        MPI_Recv(&n, 1, MPI_UNSIGNED_LONG_LONG, r, kTag, comm,
+                 MPI_STATUS_IGNORE);
+        remote.resize(n);
+        if (n > 0)
+          MPI_Recv(remote.data(), n * sizeof(Event), MPI_BYTE, r, kTag, comm,
+                   MPI_STATUS_IGNORE);
+        if (fp != NULL) writeEvents(fp, remote.data(), n, r, &first);
+      }
+      if (fp != NULL) {
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+      }
+      if (totaldropped > 0) {
+        fprintf(stderr, "trace::%llu events did not fit in the buffers\n",
+                totaldropped);
+      }
+    }
+    m_events.clear();
+    m_dropped = 0;
+    m_enabled = false;
+  }
+};
+
+#endif  // COMMON_DISTTRACE_HPP_
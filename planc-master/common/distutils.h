@@ -25,6 +25,10 @@ enum iodistributions { ONED_ROW, ONED_COL, ONED_DOUBLE, TWOD };
 // #define MPITOC toc()
 #define MPITIC mpitic()
 #define MPITOC mpitoc()
+// MPITOC that also records the region in the DistTracer timeline
+#define MPITOCTRACE(NAME, BYTES) mpitoc(NAME, BYTES)
+// MPITOCTRACE without the barrier, for the pipelined --overlap stages
+#define MPITOCLOCAL(NAME, BYTES) mpitoclocal(NAME, BYTES)
 // #define MPITIC mpitic(MPI_RANK)
 // #define MPITOC mpitoc(MPI_RANK)
 
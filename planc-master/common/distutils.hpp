@@ -5,6 +5,7 @@
 #include <mpi.h>
 #include <string>
 #include "common/distutils.h"
+#include "common/disttrace.hpp"
 #include "common/utils.h"
 #include "common/utils.hpp"
 
@@ -43,6 +44,33 @@ inline double mpitoc() {
   tictoc_stack.pop();
   return rc;
 }
+/**
+ * mpitoc(name, bytes) without the barrier of __WITH__BARRIER__TIMING__,
+ * for regions between posting a non blocking collective and its wait
+ * where a barrier would synchronize the ranks the overlap decouples.
+ * The time is the one of this rank only.
+ * @param[in] name of the region
+ * @param[in] bytes communicated by this rank in the region
+ */
+inline double mpitoclocal(const char *name, double bytes = 0) {
+  std::chrono::steady_clock::time_point begin = tictoc_stack.top();
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  tictoc_stack.pop();
+  DistTracer::instance().record(name, begin, end, bytes);
+  return std::chrono::duration_cast<std::chrono::duration<double>>(end - begin)
+      .count();
+}
+/**
+ * mpitoc that also records the region in the DistTracer timeline
+ * @param[in] name of the region
+ * @param[in] bytes communicated by this rank in the region
+ */
+inline double mpitoc(const char *name, double bytes = 0) {
+#ifdef __WITH__BARRIER__TIMING__
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  return mpitoclocal(name, bytes);
+}
 /**
  * Captures the memory usage of every mpi process
  */
@@ -93,4 +121,12 @@ inline int startidx(int n, int p, int r) {
       (r < rem) ? r * (n / p + 1) : (rem * (n / p + 1) + ((r - rem) * (n / p)));
   return idx;
 }
+
+/// MPI datatype of the matrix element type T
+template <class T>
+inline MPI_Datatype mpitype();
+template <>
+inline MPI_Datatype mpitype<double>() { return MPI_DOUBLE; }
+template <>
+inline MPI_Datatype mpitype<float>() { return MPI_FLOAT; }
 #endif  // COMMON_DISTUTILS_HPP_
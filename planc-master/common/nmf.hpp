@@ -120,12 +120,13 @@ class NMF {
   }
 
  private:
-  void otherInitializations() {
+  void otherInitializations(double normA) {
     this->stats.zeros();
     this->cleared = false;
-    this->normA = arma::norm(this->A, "fro");
+    this->normA = normA;
     this->m_num_iterations = 20;
     this->objective_err = 1000000000000;
+    this->m_symm_reg = -1;
     this->stats.resize(m_num_iterations + 1, NUM_STATS);
   }
 
@@ -154,7 +155,7 @@ class NMF {
     // absMAT<MAT>(W);
     // absMAT<MAT>(H);
     // other intializations
-    this->otherInitializations();
+    this->otherInitializations(arma::norm(this->A, "fro"));
   }
   /**
    * Constructor with initial left and right low rank factors
@@ -164,6 +165,23 @@ class NMF {
 
   NMF(const T &input, const MAT &leftlowrankfactor,
       const MAT &rightlowrankfactor): A(input) {
+    initFactors(leftlowrankfactor, rightlowrankfactor);
+    this->otherInitializations(arma::norm(this->A, "fro"));
+  }
+  /**
+   * Same as above with the frobenius norm of the input already known,
+   * which saves a pass over the input matrix.
+   * @param[in] normA frobenius norm of input
+   */
+  NMF(const T &input, const MAT &leftlowrankfactor,
+      const MAT &rightlowrankfactor, double normA): A(input) {
+    initFactors(leftlowrankfactor, rightlowrankfactor);
+    this->otherInitializations(normA);
+  }
+
+ private:
+  void initFactors(const MAT &leftlowrankfactor,
+                   const MAT &rightlowrankfactor) {
     assert(leftlowrankfactor.n_cols == rightlowrankfactor.n_cols);
     // this->A = input;
     this->W = leftlowrankfactor;
@@ -175,11 +193,9 @@ class NMF {
     this->k = W.n_cols;
     this->m_regW = arma::zeros<FVEC>(2);
     this->m_regH = arma::zeros<FVEC>(2);
-
-    // other initializations
-    this->otherInitializations();
   }
 
+ public:
   virtual void computeNMF() = 0;
 
   /// Returns the left low rank factor matrix W
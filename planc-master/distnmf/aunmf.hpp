@@ -7,9 +7,12 @@
 #include <armadillo>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <cmath>
 #include "distnmf/distnmf.hpp"
+#include "distnmf/distnodegather.hpp"
+#include "distnmf/distworkspace.hpp"
 #include "distnmf/mpicomm.hpp"
 
 /**
@@ -35,38 +38,92 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
   MAT WtAij;  /// WtAij is of size k*(globaln/p)
   MAT Wt;     /// Wt is of size k*(globalm/p)
   MAT Ht;     /// Ht is of size k*(globaln/p)
+  MAT errWtW;  /// WtW before applyReg, the error needs the plain Grams
+  MAT errHtH;  /// HtH before applyReg
 
   virtual void updateW() = 0;
   virtual void updateH() = 0;
 
+  /**
+   * Stopping rule of the inner sweeps HALS and MU run per distributed
+   * product, after Gillis and Glineur, Neural Computation 24(4), 2012.
+   * change is the squared frobenius norm of the local change of the factor
+   * in sweep. The sweeps stop once it falls below innertol^2 times the one
+   * of the first sweep, or after inneriter sweeps. The rows of a factor
+   * are independent subproblems given the k x k Gram and the product with
+   * A, so the rule needs no communication and the ranks may stop after a
+   * different number of sweeps.
+   * @param[in,out] first change of the first sweep, set when sweep is 0
+   */
+  bool innerConverged(unsigned int sweep, double change, double *first) {
+    this->time_stats.inner_sweeps(1);
+    if (sweep == 0) *first = change;
+    return sweep + 1 >= m_inneriter ||
+           change <= m_innertol * m_innertol * *first;
+  }
+
+  // extrapolation between the outer iterations, see set_extrapolate
+  bool m_extrapolate;
+  MAT m_Wlast, m_Hlast;  /// last W and H of the inner solver
+  double m_beta, m_betamax, m_lasterr;
+  int m_restarts;
+
  private:
+  // The gathered factor blocks, their products with A and the buffers they
+  // are communicated in have the element type of A, so that a float input
+  // halves the traffic and the memory of the 2D multiplies. The k x k
+  // Grams, the right hand sides of the NNLS solves and the error terms
+  // stay in double.
+  typedef typename INPUTMATTYPE::elem_type eT;
+  typedef arma::Mat<eT> AMAT;
+
   // Things needed while solving for W
   MAT localHtH;         /// H is of size (globaln/p)*k;
-  MAT Hjt, Hj;          /// Hj is of size n*k;
-  MAT AijHj, AijHjt;    /// AijHj is of size m*k;
+  AMAT Hjt, Hj;         /// Hj is of size n*k;
+  AMAT AijHj, AijHjt;   /// AijHj is of size m*k;
   // INPUTMATTYPE A_ij_t;  /// n*m matrix. Transpose of A_ij
   // Things needed while solving for H
-  MAT localWtW;        /// W is of size (globalm/p)*k;
-  MAT Wit, Wi;         /// Wi is of size m*k;
-  MAT WitAij, AijWit;  /// WijtAij is of size k*n;
+  MAT localWtW;         /// W is of size (globalm/p)*k;
+  AMAT Wit, Wi;         /// Wi is of size m*k;
+  AMAT WitAij, AijWit;  /// WijtAij is of size k*n;
 
   // needed for error computation
   MAT prevH;        // used for error computation
   MAT prevHtH;      // used for error computation
   MAT WtAijH;       /// global k*k matrix.
   MAT localWtAijH;  /// local k*k matrix
-  MAT errMtx;
-  MAT A_errMtx;
+  AMAT errMtx;
+  AMAT A_errMtx;
+  int m_errcheck;   /// dense only, residual every m_errcheck iterations
+  unsigned int m_inneriter;  /// HALS and MU, see set_inneriter
+  double m_innertol;
 
   // needed for symm regularization
   MAT crossFac;     // holds the appropriate row of W,H
   int paired_proc;  // processor to swap factors with
 
   // needed for block implementation to save memory
-  MAT Ht_blk;
-  MAT AHtij_blk;
-  MAT Wt_blk;
-  MAT WtAij_blk;
+  AMAT Ht_blk;
+  AMAT AHtij_blk;
+  AMAT Wt_blk;
+  AMAT WtAij_blk;
+
+  // second buffers of the pipelined k block multiplies. Block i uses the
+  // buffers above when i is even and these when i is odd.
+  bool m_overlap;
+  AMAT Ht_blk_nxt, Hjt_nxt, AijHjt_nxt, AHtij_blk_nxt;
+  AMAT Wt_blk_nxt, Wit_nxt, WitAij_nxt, WtAij_blk_nxt;
+
+  // node shared replacements of Wit and Hjt, see set_nodegather
+  DistNodeGather<eT> m_nodeWit, m_nodeHjt;
+
+  // The large buffers of the multiplies and of the dense error, in the
+  // slot order of DistNMFWorkspace. The overlap buffers come last.
+  enum wsbuffer {
+    WS_HJT, WS_AIJHJT, WS_WIT, WS_WITAIJ, WS_ERRMTX, WS_A_ERRMTX,
+    WS_HJT_NXT, WS_AIJHJT_NXT, WS_WIT_NXT, WS_WITAIJ_NXT, WS_NUM_BUFFERS
+  };
+  bool m_workspace;  /// whether the buffers are borrowed
 
   // Gatherv and Reducescatter variables
   std::vector<int> gatherWtAcnts;
@@ -93,10 +150,8 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
                         << this->globaln() << "::MPI_SIZE::" << MPI_SIZE);
     HtH.zeros(this->k, this->k);
     localHtH.zeros(this->k, this->k);
-    Hj.zeros(this->n, this->perk);
-    Hjt.zeros(this->perk, this->n);
-    AijHj.zeros(this->m, this->perk);
-    AijHjt.zeros(this->perk, this->m);
+    bindBuffer(WS_HJT);
+    bindBuffer(WS_AIJHJT);
     AHtij.zeros(this->k, this->W.n_rows);
     this->scatterAHcnts.resize(NUMCOLPROCS);
     int fillsize = this->perk * (this->W.n_rows);
@@ -119,10 +174,8 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
     Wt.zeros(this->k, this->W.n_rows);
     WtW.zeros(this->k, this->k);
     localWtW.zeros(this->k, this->k);
-    Wi.zeros(this->m, this->perk);
-    Wit.zeros(this->perk, this->m);
-    WitAij.zeros(this->perk, this->n);
-    AijWit.zeros(this->n, this->perk);
+    bindBuffer(WS_WIT);
+    bindBuffer(WS_WITAIJ);
     WtAij.zeros(this->k, this->H.n_rows);
     this->scatterWtAcnts.resize(NUMROWPROCS);
     fillsize = this->perk * (this->H.n_rows);
@@ -146,20 +199,55 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
       printVector<int>(recvWtAsize);
     }
 #endif
-#ifndef BUILD_SPARSE
-    if (this->is_compute_error()) {
-      errMtx.zeros(this->m, this->n);
-      A_errMtx.zeros(this->m, this->n);
+  }
+
+  /// Shape of a workspace buffer for the local A of size m x n
+  static void bufferShape(int slot, UWORD m, UWORD n, int perk, UWORD *rows,
+                          UWORD *cols) {
+    switch (slot) {
+      case WS_ERRMTX:
+      case WS_A_ERRMTX:
+        *rows = m;
+        *cols = n;
+        break;
+      case WS_AIJHJT:
+      case WS_AIJHJT_NXT:
+      case WS_WIT:
+      case WS_WIT_NXT:
+        *rows = perk;
+        *cols = m;
+        break;
+      default:
+        *rows = perk;
+        *cols = n;
+    }
+  }
+
+  AMAT *buffer(int slot) {
+    AMAT *buffers[WS_NUM_BUFFERS] = {&Hjt, &AijHjt, &Wit, &WitAij,
+                                     &errMtx, &A_errMtx, &Hjt_nxt,
+                                     &AijHjt_nxt, &Wit_nxt, &WitAij_nxt};
+    return buffers[slot];
+  }
+
+  /**
+   * Shapes a buffer for the current k. A borrowed buffer keeps the
+   * contents of the previous run, every use overwrites it completely.
+   */
+  void bindBuffer(int slot) {
+    UWORD rows, cols;
+    bufferShape(slot, this->m, this->n, this->perk, &rows, &cols);
+    if (!m_workspace ||
+        !DistNMFWorkspace<eT>::instance().bind(slot, rows, cols,
+                                               buffer(slot))) {
+      buffer(slot)->zeros(rows, cols);
     }
-#endif
   }
 
   void freeMatrices() {
     HtH.clear();
     localHtH.clear();
-    Hj.clear();
     Hjt.clear();
-    AijHj.clear();
     AijHjt.clear();
     AHtij.clear();
     Wt.clear();
@@ -168,7 +256,6 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
     Wi.clear();
     Wit.clear();
     WitAij.clear();
-    AijWit.clear();
     WtAij.clear();
     // A_ij_t.clear();
     if (this->is_compute_error()) {
@@ -242,6 +329,12 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
     num_k_blocks = numkblks;
     relative_error_dir = relerr_dir;
     perk = this->k / num_k_blocks;
+    m_overlap = false;
+    m_errcheck = 0;
+    m_inneriter = 1;
+    m_innertol = 0;
+    m_extrapolate = false;
+    m_workspace = DistNMFWorkspace<eT>::instance().acquire();
     allocateMatrices();
     setupCommcounts();
     this->Wt = leftlowrankfactor.t();
@@ -259,6 +352,36 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
   }
   ~DistAUNMF() {
     // freeMatrices();
+    if (m_workspace) DistNMFWorkspace<eT>::instance().release();
+  }
+
+  /**
+   * Reserves the workspace buffers for the largest rank of a sweep, so
+   * that the footprint is fixed before the first run and no later run
+   * allocates them.
+   * @param[in] m, n local size of A
+   * @param[in] perk largest k divided by the number of k blocks
+   * @param[in] dense_error whether computeError2 runs, see set_errcheck
+   * @param[in] overlap whether the pipelined multiplies run
+   * @param[in] nodegather whether Wit and Hjt live in shared memory
+   * @return bytes of the workspace
+   */
+  static double reserveWorkspace(UWORD m, UWORD n, int perk, bool dense_error,
+                                 bool overlap, bool nodegather) {
+    DistNMFWorkspace<eT> &ws = DistNMFWorkspace<eT>::instance();
+    for (int slot = 0; slot < WS_NUM_BUFFERS; slot++) {
+      if (slot == WS_ERRMTX || slot == WS_A_ERRMTX) {
+        if (!dense_error) continue;
+      } else if (slot >= WS_HJT_NXT) {
+        if (!overlap) continue;
+      } else if (slot == WS_HJT || slot == WS_WIT) {
+        if (nodegather) continue;
+      }
+      UWORD rows, cols;
+      bufferShape(slot, m, n, perk, &rows, &cols);
+      ws.reserve(slot, rows * cols);
+    }
+    return ws.bytes();
   }
 
   /**
@@ -275,15 +398,23 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
    * this->m_mpicomm.comm_subs()[1] is row communicator.
    */
   void distWtA() {
+#ifndef USE_PACOSS
+    if (m_overlap) {
+      distWtAPipelined();
+      return;
+    }
+#endif
     for (int i = 0; i < num_k_blocks; i++) {
       int start_row = i * perk;
       int end_row = (i + 1) * perk - 1;
-      Wt_blk = Wt.rows(start_row, end_row);
+      Wt_blk = arma::conv_to<AMAT>::from(Wt.rows(start_row, end_row));
       distWtABlock();
-      WtAij.rows(start_row, end_row) = WtAij_blk;
+      WtAij.rows(start_row, end_row) = arma::conv_to<MAT>::from(WtAij_blk);
     }
   }
   void distWtABlock() {
+    double gatherbytes = sizeof(eT) * (Wit.n_elem - Wt_blk.n_elem);
+    double scatterbytes = sizeof(eT) * (WitAij.n_elem - WtAij_blk.n_elem);
 #ifdef USE_PACOSS
     // Perform expand communication using Pacoss.
     memcpy(Wit.memptr(), Wt_blk.memptr(),
@@ -293,13 +424,19 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
     this->m_rowcomm->expCommFinish(Wit.memptr(), this->perk);
 #else
     int sendcnt = (this->W.n_rows) * this->perk;
-    Wit.zeros();
-    MPITIC;  // allgather WtA
-    MPI_Allgatherv(Wt_blk.memptr(), sendcnt, MPI_DOUBLE, Wit.memptr(),
-                  &(gatherWtAcnts[0]), &(gatherWtAdisp[0]), MPI_DOUBLE,
-                  this->m_mpicomm.commSubs()[1]);
+    if (m_nodeWit.active()) {
+      gatherbytes = m_nodeWit.recvbytes();
+      MPITIC;  // allgather WtA
+      m_nodeWit.gather(Wt_blk.memptr(), sendcnt);
+    } else {
+      Wit.zeros();
+      MPITIC;  // allgather WtA
+      MPI_Allgatherv(Wt_blk.memptr(), sendcnt, mpitype<eT>(), Wit.memptr(),
+                    &(gatherWtAcnts[0]), &(gatherWtAdisp[0]), mpitype<eT>(),
+                    this->m_mpicomm.commSubs()[1]);
+    }
 #endif
-    double temp = MPITOC;  // allgather WtA
+    double temp = MPITOCTRACE("WtA::allgather", gatherbytes);
     PRINTROOT("n::" << this->n << "::k::" << this->k << PRINTMATINFO(Wt)
                     << PRINTMATINFO(Wit));
 #ifdef MPI_VERBOSE
@@ -307,9 +444,15 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
     DISTPRINTINFO(PRINTMAT(Wit));
 #endif
     this->time_stats.communication_duration(temp);
-    this->time_stats.allgather_duration(temp);
+    this->time_stats.allgather_duration(temp, gatherbytes);
     MPITIC;  // mm WtA
-    this->WitAij = this->Wit * this->A;
+    if (m_nodeWit.active()) {
+      const AMAT Wshared(m_nodeWit.memptr(), this->perk, this->m, false,
+                         true);
+      this->WitAij = Wshared * this->A;
+    } else {
+      this->WitAij = this->Wit * this->A;
+    }
     // #if defined(MKL_FOUND) && defined(BUILD_SPARSE)
     //     // void ARMAMKLSCSCMM(const SRC &mklMat, const DESTN &Bt, const char
     //     transa,
@@ -322,7 +465,7 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
     // #else
     //     this->WitAij = this->Wit * this->A;
     // #endif
-    temp = MPITOC;  // mm WtA
+    temp = MPITOCTRACE("WtA::mm", 0);  // mm WtA
 #ifdef MPI_VERBOSE
     DISTPRINTINFO(PRINTMAT(this->WitAij));
 #endif
@@ -330,25 +473,24 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
               << PRINTMATINFO(this->Wit) << PRINTMATINFO(this->WitAij));
     this->time_stats.compute_duration(temp);
     this->time_stats.mm_duration(temp);
-    this->reportTime(temp, "WtA::");
 #ifdef USE_PACOSS
     // Perform fold communication using Pacoss.
     MPITIC;
     this->m_colcomm->foldCommBegin(WitAij.memptr(), this->perk);
     this->m_colcomm->foldCommFinish(WitAij.memptr(), this->perk);
-    temp = MPITOC;
+    temp = MPITOCTRACE("WtA::reducescatter", scatterbytes);
     memcpy(WtAij_blk.memptr(), WitAij.memptr(),
            WtAij_blk.n_rows * WtAij_blk.n_cols * sizeof(WtAij_blk[0]));
 #else
     WtAij_blk.zeros();
     MPITIC;  // reduce_scatter WtA
     MPI_Reduce_scatter(this->WitAij.memptr(), this->WtAij_blk.memptr(),
-                       &(scatterWtAcnts[0]), MPI_DOUBLE, MPI_SUM,
+                       &(scatterWtAcnts[0]), mpitype<eT>(), MPI_SUM,
                        this->m_mpicomm.commSubs()[0]);
-    temp = MPITOC;  // reduce_scatter WtA
+    temp = MPITOCTRACE("WtA::reducescatter", scatterbytes);
 #endif
     this->time_stats.communication_duration(temp);
-    this->time_stats.reducescatter_duration(temp);
+    this->time_stats.reducescatter_duration(temp, scatterbytes);
   }
   /**
    * There are totally prxpc process.
@@ -362,15 +504,23 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
    * To preserve the memory for Hj, we collect only partial k
    */
   void distAH() {
+#ifndef USE_PACOSS
+    if (m_overlap) {
+      distAHPipelined();
+      return;
+    }
+#endif
     for (int i = 0; i < num_k_blocks; i++) {
       int start_row = i * perk;
       int end_row = (i + 1) * perk - 1;
-      Ht_blk = Ht.rows(start_row, end_row);
+      Ht_blk = arma::conv_to<AMAT>::from(Ht.rows(start_row, end_row));
       distAHBlock();
-      AHtij.rows(start_row, end_row) = AHtij_blk;
+      AHtij.rows(start_row, end_row) = arma::conv_to<MAT>::from(AHtij_blk);
     }
   }
   void distAHBlock() {
+    double gatherbytes = sizeof(eT) * (Hjt.n_elem - Ht_blk.n_elem);
+    double scatterbytes = sizeof(eT) * (AijHjt.n_elem - AHtij_blk.n_elem);
     /*
     DISTPRINTINFO("distAH::" << "::Acolst::" \
                   Acolst.n_rows<<"x"<<Acolst.n_cols \
@@ -387,22 +537,29 @@ class DistAUNMF : public DistNMF<INPUTMATTYPE> {
     this->m_colcomm->expCommFinish(Hjt.memptr(), this->perk);
 #else
     int sendcnt = (this->H.n_rows) * this->perk;
-    Hjt.zeros();
-    MPITIC;  // allgather AH
-    MPI_Allgatherv(this->Ht_blk.memptr(), sendcnt, MPI_DOUBLE,
-                  this->Hjt.memptr(), &(gatherAHcnts[0]), &(gatherAHdisp[0]),
-                  MPI_DOUBLE, this->m_mpicomm.commSubs()[0]);
+    if (m_nodeHjt.active()) {
+      gatherbytes = m_nodeHjt.recvbytes();
+      MPITIC;  // allgather AH
+      m_nodeHjt.gather(Ht_blk.memptr(), sendcnt);
+    } else {
+      Hjt.zeros();
+      MPITIC;  // allgather AH
+      MPI_Allgatherv(this->Ht_blk.memptr(), sendcnt, mpitype<eT>(),
+                    this->Hjt.memptr(), &(gatherAHcnts[0]),
+                    &(gatherAHdisp[0]), mpitype<eT>(),
+                    this->m_mpicomm.commSubs()[0]);
+    }
 #endif
     PRINTROOT("n::" << this->n << "::k::" << this->k << PRINTMATINFO(Ht)
                     << PRINTMATINFO(Hjt));
-    double temp = MPITOC;  // allgather AH
+    double temp = MPITOCTRACE("AH::allgather", gatherbytes);
 #ifdef MPI_VERBOSE
     DISTPRINTINFO(PRINTMAT(Ht_blk));
     DISTPRINTINFO(PRINTMAT(Hjt));
     // DISTPRINTINFO(PRINTMAT(this->A_ij_t));
 #endif
     this->time_stats.communication_duration(temp);
-    this->time_stats.allgather_duration(temp);
+    this->time_stats.allgather_duration(temp, gatherbytes);
     MPITIC;  // mm AH
 /*
 #ifdef BUILD_SPARSE
@@ -416,7 +573,13 @@ More memory efficient to rewrite code as above since A.t() will construct a
 copy of the A in the sparse case. However sparse x dense matmul is much slower
 than in dense x sparse. Keeping current version for performance reasons.
 */
-    this->AijHjt = this->Hjt * this->A.t();
+    if (m_nodeHjt.active()) {
+      const AMAT Hshared(m_nodeHjt.memptr(), this->perk, this->n, false,
+                         true);
+      this->AijHjt = Hshared * this->A.t();
+    } else {
+      this->AijHjt = this->Hjt * this->A.t();
+    }
     // #if defined(MKL_FOUND) && defined(BUILD_SPARSE)
     //     // void ARMAMKLSCSCMM(const SRC &mklMat, const DESTN &Bt, const char
     //     transa,
@@ -432,37 +595,184 @@ than in dense x sparse. Keeping current version for performance reasons.
     // #ifdef MPI_VERBOSE
     //     DISTPRINTINFO(PRINTMAT(this->AijHjt));
     // #endif
-    temp = MPITOC;  // mm AH
+    temp = MPITOCTRACE("AH::mm", 0);  // mm AH
     // PRINTROOT(PRINTMATINFO(this->A_ij_t)
     PRINTROOT(PRINTMATINFO(this->Hjt) << PRINTMATINFO(this->AijHjt));
     this->time_stats.compute_duration(temp);
     this->time_stats.mm_duration(temp);
-    this->reportTime(temp, "AH::");
 #ifdef USE_PACOSS
     // Perform fold communication using Pacoss.
     MPITIC;
     this->m_rowcomm->foldCommBegin(AijHjt.memptr(), this->perk);
     this->m_rowcomm->foldCommFinish(AijHjt.memptr(), this->perk);
-    temp = MPITOC;
+    temp = MPITOCTRACE("AH::reducescatter", scatterbytes);
     memcpy(AHtij_blk.memptr(), AijHjt.memptr(),
            AHtij_blk.n_rows * AHtij_blk.n_cols * sizeof(AHtij_blk[0]));
 #else
     AHtij_blk.zeros();
     MPITIC;  // reduce_scatter AH
     MPI_Reduce_scatter(this->AijHjt.memptr(), this->AHtij_blk.memptr(),
-                       &(this->scatterAHcnts[0]), MPI_DOUBLE, MPI_SUM,
+                       &(this->scatterAHcnts[0]), mpitype<eT>(), MPI_SUM,
                        this->m_mpicomm.commSubs()[1]);
-    temp = MPITOC;  // reduce_scatter AH
+    temp = MPITOCTRACE("AH::reducescatter", scatterbytes);
 #endif
     this->time_stats.communication_duration(temp);
-    this->time_stats.reducescatter_duration(temp);
+    this->time_stats.reducescatter_duration(temp, scatterbytes);
   }
+#ifndef USE_PACOSS
+  /**
+   * Software pipelined distWtA. The allgather of block i+1 and the
+   * reduce_scatter of block i-1 are in flight while block i is multiplied,
+   * so every buffer touched by a non blocking collective has a second copy.
+   * A buffer is written only after the request that last used it completed.
+   * The stages are timed with MPITOCLOCAL, as a barrier per stage would
+   * serialize the ranks, so their times are those of every rank by itself
+   * and a wait includes the lag of the slower ranks.
+   */
+  void distWtAPipelined() {
+    AMAT *sendbuf[2] = {&Wt_blk, &Wt_blk_nxt};
+    AMAT *gathered[2] = {&Wit, &Wit_nxt};
+    AMAT *product[2] = {&WitAij, &WitAij_nxt};
+    AMAT *scattered[2] = {&WtAij_blk, &WtAij_blk_nxt};
+    MPI_Request gatherreq[2], scatterreq[2];
+    int sendcnt = (this->W.n_rows) * this->perk;
+    double gatherbytes = sizeof(eT) * (Wit.n_elem - sendcnt);
+    double scatterbytes = sizeof(eT) * (WitAij.n_elem - WtAij_blk.n_elem);
+    MPITIC;  // allgather WtA
+    *sendbuf[0] = arma::conv_to<AMAT>::from(Wt.rows(0, perk - 1));
+    MPI_Iallgatherv(sendbuf[0]->memptr(), sendcnt, mpitype<eT>(),
+                    gathered[0]->memptr(), &(gatherWtAcnts[0]),
+                    &(gatherWtAdisp[0]), mpitype<eT>(),
+                    this->m_mpicomm.commSubs()[1], &gatherreq[0]);
+    double temp = MPITOCLOCAL("WtA::allgather", 0);  // allgather WtA
+    this->time_stats.communication_duration(temp);
+    this->time_stats.allgather_duration(temp);
+    for (int i = 0; i < num_k_blocks; i++) {
+      int cur = i % 2, nxt = 1 - cur;
+      MPITIC;  // allgather WtA
+      if (i + 1 < num_k_blocks) {
+        *sendbuf[nxt] = arma::conv_to<AMAT>::from(
+            Wt.rows((i + 1) * perk, (i + 2) * perk - 1));
+        MPI_Iallgatherv(sendbuf[nxt]->memptr(), sendcnt, mpitype<eT>(),
+                        gathered[nxt]->memptr(), &(gatherWtAcnts[0]),
+                        &(gatherWtAdisp[0]), mpitype<eT>(),
+                        this->m_mpicomm.commSubs()[1], &gatherreq[nxt]);
+      }
+      MPI_Wait(&gatherreq[cur], MPI_STATUS_IGNORE);
+      temp = MPITOCLOCAL("WtA::allgather", gatherbytes);
+      this->time_stats.communication_duration(temp);
+      this->time_stats.allgather_duration(temp, gatherbytes);
+      if (i >= 2) {
+        // product[cur] is still the send buffer of block i-2
+        MPITIC;  // reduce_scatter WtA
+        MPI_Wait(&scatterreq[cur], MPI_STATUS_IGNORE);
+        temp = MPITOCLOCAL("WtA::reducescatter", scatterbytes);
+        this->time_stats.communication_duration(temp);
+        this->time_stats.reducescatter_duration(temp, scatterbytes);
+        WtAij.rows((i - 2) * perk, (i - 1) * perk - 1) =
+            arma::conv_to<MAT>::from(*scattered[cur]);
+      }
+      MPITIC;  // mm WtA
+      *product[cur] = *gathered[cur] * this->A;
+      temp = MPITOCLOCAL("WtA::mm", 0);  // mm WtA
+      this->time_stats.compute_duration(temp);
+      this->time_stats.mm_duration(temp);
+      MPITIC;  // reduce_scatter WtA
+      MPI_Ireduce_scatter(product[cur]->memptr(), scattered[cur]->memptr(),
+                          &(scatterWtAcnts[0]), mpitype<eT>(), MPI_SUM,
+                          this->m_mpicomm.commSubs()[0], &scatterreq[cur]);
+      temp = MPITOCLOCAL("WtA::reducescatter", 0);  // reduce_scatter WtA
+      this->time_stats.communication_duration(temp);
+      this->time_stats.reducescatter_duration(temp);
+    }
+    for (int i = std::max(0, num_k_blocks - 2); i < num_k_blocks; i++) {
+      MPITIC;  // reduce_scatter WtA
+      MPI_Wait(&scatterreq[i % 2], MPI_STATUS_IGNORE);
+      temp = MPITOCLOCAL("WtA::reducescatter", scatterbytes);
+      this->time_stats.communication_duration(temp);
+      this->time_stats.reducescatter_duration(temp, scatterbytes);
+      WtAij.rows(i * perk, (i + 1) * perk - 1) =
+          arma::conv_to<MAT>::from(*scattered[i % 2]);
+    }
+  }
+  /**
+   * Software pipelined distAH with the same double buffering as
+   * distWtAPipelined.
+   */
+  void distAHPipelined() {
+    AMAT *sendbuf[2] = {&Ht_blk, &Ht_blk_nxt};
+    AMAT *gathered[2] = {&Hjt, &Hjt_nxt};
+    AMAT *product[2] = {&AijHjt, &AijHjt_nxt};
+    AMAT *scattered[2] = {&AHtij_blk, &AHtij_blk_nxt};
+    MPI_Request gatherreq[2], scatterreq[2];
+    int sendcnt = (this->H.n_rows) * this->perk;
+    double gatherbytes = sizeof(eT) * (Hjt.n_elem - sendcnt);
+    double scatterbytes = sizeof(eT) * (AijHjt.n_elem - AHtij_blk.n_elem);
+    MPITIC;  // allgather AH
+    *sendbuf[0] = arma::conv_to<AMAT>::from(Ht.rows(0, perk - 1));
+    MPI_Iallgatherv(sendbuf[0]->memptr(), sendcnt, mpitype<eT>(),
+                    gathered[0]->memptr(), &(gatherAHcnts[0]),
+                    &(gatherAHdisp[0]), mpitype<eT>(),
+                    this->m_mpicomm.commSubs()[0], &gatherreq[0]);
+    double temp = MPITOCLOCAL("AH::allgather", 0);  // allgather AH
+    this->time_stats.communication_duration(temp);
+    this->time_stats.allgather_duration(temp);
+    for (int i = 0; i < num_k_blocks; i++) {
+      int cur = i % 2, nxt = 1 - cur;
+      MPITIC;  // allgather AH
+      if (i + 1 < num_k_blocks) {
+        *sendbuf[nxt] = arma::conv_to<AMAT>::from(
+            Ht.rows((i + 1) * perk, (i + 2) * perk - 1));
+        MPI_Iallgatherv(sendbuf[nxt]->memptr(), sendcnt, mpitype<eT>(),
+                        gathered[nxt]->memptr(), &(gatherAHcnts[0]),
+                        &(gatherAHdisp[0]), mpitype<eT>(),
+                        this->m_mpicomm.commSubs()[0], &gatherreq[nxt]);
+      }
+      MPI_Wait(&gatherreq[cur], MPI_STATUS_IGNORE);
+      temp = MPITOCLOCAL("AH::allgather", gatherbytes);
+      this->time_stats.communication_duration(temp);
+      this->time_stats.allgather_duration(temp, gatherbytes);
+      if (i >= 2) {
+        MPITIC;  // reduce_scatter AH
+        MPI_Wait(&scatterreq[cur], MPI_STATUS_IGNORE);
+        temp = MPITOCLOCAL("AH::reducescatter", scatterbytes);
+        this->time_stats.communication_duration(temp);
+        this->time_stats.reducescatter_duration(temp, scatterbytes);
+        AHtij.rows((i - 2) * perk, (i - 1) * perk - 1) =
+            arma::conv_to<MAT>::from(*scattered[cur]);
+      }
+      MPITIC;  // mm AH
+      *product[cur] = *gathered[cur] * this->A.t();
+      temp = MPITOCLOCAL("AH::mm", 0);  // mm AH
+      this->time_stats.compute_duration(temp);
+      this->time_stats.mm_duration(temp);
+      MPITIC;  // reduce_scatter AH
+      MPI_Ireduce_scatter(product[cur]->memptr(), scattered[cur]->memptr(),
+                          &(this->scatterAHcnts[0]), mpitype<eT>(), MPI_SUM,
+                          this->m_mpicomm.commSubs()[1], &scatterreq[cur]);
+      temp = MPITOCLOCAL("AH::reducescatter", 0);  // reduce_scatter AH
+      this->time_stats.communication_duration(temp);
+      this->time_stats.reducescatter_duration(temp);
+    }
+    for (int i = std::max(0, num_k_blocks - 2); i < num_k_blocks; i++) {
+      MPITIC;  // reduce_scatter AH
+      MPI_Wait(&scatterreq[i % 2], MPI_STATUS_IGNORE);
+      temp = MPITOCLOCAL("AH::reducescatter", scatterbytes);
+      this->time_stats.communication_duration(temp);
+      this->time_stats.reducescatter_duration(temp, scatterbytes);
+      AHtij.rows(i * perk, (i + 1) * perk - 1) =
+          arma::conv_to<MAT>::from(*scattered[i % 2]);
+    }
+  }
+#endif  // ifndef USE_PACOSS
   /**
    * There are p processes.
    * Every process i has W in m_i * k
    * At the end of this call, all process will have
    * WtW of size k*k is symmetric. So not to worry
    * about column/row major formats.
+   * The sums queued on m_reducer before the call are reduced in the same
+   * collective as the gram matrix.
    * @param[in] X is of size m_i x k
    * @param[out] XtX Every process owns the same kxk global gram matrix of X
    */
@@ -474,21 +784,17 @@ than in dense x sparse. Keeping current version for performance reasons.
     DISTPRINTINFO("W::" << norm(X, "fro")
                         << "::localWtW::" << norm(this->localWtW, "fro"));
 #endif
-    double temp = MPITOC;  // gram
+    double temp = MPITOCTRACE("Gram", 0);  // gram
     this->time_stats.compute_duration(temp);
     this->time_stats.gram_duration(temp);
     (*XtX).zeros();
-    if (X.n_rows == this->m) {
-      this->reportTime(temp, "Gram::W::");
-    } else {
-      this->reportTime(temp, "Gram::H::");
-    }
     MPITIC;  // allreduce gram
-    MPI_Allreduce(localWtW.memptr(), (*XtX).memptr(), this->k * this->k,
-                  MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    temp = MPITOC;  // allreduce gram
+    this->m_reducer.add(localWtW.memptr(), (*XtX).memptr(), this->k * this->k);
+    double bytes = 8.0 * this->m_reducer.size();
+    this->m_reducer.allreduce(MPI_COMM_WORLD);
+    temp = MPITOCTRACE("Gram::allreduce", bytes);  // allreduce gram
     this->time_stats.communication_duration(temp);
-    this->time_stats.allreduce_duration(temp);
+    this->time_stats.allreduce_duration(temp, bytes);
   }
   /**
    * This is the main loop function
@@ -500,21 +806,36 @@ than in dense x sparse. Keeping current version for performance reasons.
 #ifdef MPI_VERBOSE
     DISTPRINTINFO(PRINTMAT(this->A));
 #endif
+    if (m_extrapolate) {
+      // the restart is decided on the error of every iteration
+      this->compute_error(true);
+      m_beta = 0.5;
+      m_betamax = 1;
+      m_restarts = 0;
+    }
     // error computation
     if (this->is_compute_error()) {
       prevH.zeros(size(this->H));
       prevHtH.zeros(this->k, this->k);
       WtAijH.zeros(this->k, this->k);
       localWtAijH.zeros(this->k, this->k);
+#ifndef BUILD_SPARSE
+      if (m_errcheck > 0 || this->symm_reg() > 0) {
+        bindBuffer(WS_ERRMTX);
+        bindBuffer(WS_A_ERRMTX);
+      }
+#endif
     }
 #ifdef __WITH__BARRIER__TIMING__
     MPI_Barrier(MPI_COMM_WORLD);
 #endif
     for (unsigned int iter = 0; iter < this->num_iterations(); iter++) {
+      this->time_stats.trace_iteration(iter);
+      DistTracer::instance().iteration(iter);
       // saving current instance for error computation.
       if (iter > 0 && this->is_compute_error()) {
         this->prevH = this->H;
-        this->prevHtH = this->HtH;
+        this->prevHtH = this->errHtH;
       }
       MPITIC;  // total_d W&H
       // update H given WtW and WtA step 4 of the algorithm
@@ -522,6 +843,7 @@ than in dense x sparse. Keeping current version for performance reasons.
         // compute WtW
         this->distInnerProduct(this->W, &this->WtW);
         PRINTROOT(PRINTMATINFO(this->WtW));
+        this->errWtW = this->WtW;
         this->applyReg(this->regH(), &this->WtW);
 #ifdef MPI_VERBOSE
         PRINTROOT(PRINTMAT(this->WtW));
@@ -537,9 +859,9 @@ than in dense x sparse. Keeping current version for performance reasons.
           MPI_Sendrecv(this->Wt.memptr(), sendsize, MPI_DOUBLE, paired_proc, 0,
               this->crossFac.memptr(), recvsize, MPI_DOUBLE, paired_proc, 0,
               this->m_mpicomm.gridComm(), MPI_STATUS_IGNORE);
-          double temp = MPITOC;  // sendrecv
+          double temp = MPITOCTRACE("H::sendrecv", 8.0 * sendsize);  // sendrecv
           this->time_stats.communication_duration(temp);
-          this->time_stats.sendrecv_duration(temp);
+          this->time_stats.sendrecv_duration(temp, 8.0 * sendsize);
 
           this->applySymmetricReg(this->symm_reg(), &this->WtW,
                   &this->crossFac, &this->WtAij);
@@ -555,16 +877,30 @@ than in dense x sparse. Keeping current version for performance reasons.
 #ifdef MPI_VERBOSE
         DISTPRINTINFO("::it=" << iter << PRINTMAT(this->H));
 #endif
-        double temp = MPITOC;  // nnls H
+        double temp = MPITOCTRACE("NNLS::H", 0);  // nnls H
         this->time_stats.compute_duration(temp);
         this->time_stats.nnls_duration(temp);
-        this->reportTime(temp, "NNLS::H::");
+        if (m_extrapolate) {
+          extrapolate(iter, &this->H, &m_Hlast);
+          this->Ht = this->H.t();
+        }
       }
       // Update W given HtH and AH step 3 of the algorithm.
+      this->time_stats.trace_update_W();
       {
+        // the error terms are reduced together with HtH
+#ifdef BUILD_SPARSE
+        if (iter > 0 && this->is_compute_error())
+          this->queueError(this->prevH);
+#else
+        // the dense error is the one of the new H, as in computeError2
+        if (iter > 0 && this->is_compute_error() && this->symm_reg() <= 0)
+          this->queueError(this->H);
+#endif
         // compute HtH
         this->distInnerProduct(this->H, &this->HtH);
         PRINTROOT("HtH::" << PRINTMATINFO(this->HtH));
+        this->errHtH = this->HtH;
         this->applyReg(this->regW(), &this->HtH);
 #ifdef MPI_VERBOSE
         PRINTROOT(PRINTMAT(this->HtH));
@@ -580,9 +916,9 @@ than in dense x sparse. Keeping current version for performance reasons.
           MPI_Sendrecv(this->Ht.memptr(), sendsize, MPI_DOUBLE, paired_proc, 0,
               this->crossFac.memptr(), recvsize, MPI_DOUBLE, paired_proc, 0,
               this->m_mpicomm.gridComm(), MPI_STATUS_IGNORE);
-          double temp = MPITOC;  // sendrecv
+          double temp = MPITOCTRACE("W::sendrecv", 8.0 * sendsize);  // sendrecv
           this->time_stats.communication_duration(temp);
-          this->time_stats.sendrecv_duration(temp);
+          this->time_stats.sendrecv_duration(temp, 8.0 * sendsize);
 
           this->applySymmetricReg(this->symm_reg(), &this->HtH,
                 &this->crossFac, &this->AHtij);
@@ -599,17 +935,44 @@ than in dense x sparse. Keeping current version for performance reasons.
 #ifdef MPI_VERBOSE
         DISTPRINTINFO("::it=" << iter << PRINTMAT(this->W));
 #endif
-        double temp = MPITOC;  // nnls W
+        double temp = MPITOCTRACE("NNLS::W", 0);  // nnls W
         this->time_stats.compute_duration(temp);
         this->time_stats.nnls_duration(temp);
-        this->reportTime(temp, "NNLS::W::");
+        if (m_extrapolate) {
+          extrapolate(iter, &this->W, &m_Wlast);
+          this->Wt = this->W.t();
+        }
       }
-      this->time_stats.duration(MPITOC);  // total_d W&H
+      this->time_stats.duration(MPITOCTRACE("iteration", 0));  // total_d W&H
       if (iter > 0 && this->is_compute_error()) {
+        // the symmetric differences share the allreduce of the error
+        double localsymm[2], globalsymm[2];
+        if (this->symm_reg() > 0) {
+          localsymm[0] = arma::norm(this->Wt - this->crossFac, "fro");
+          localsymm[1] = arma::norm(this->Wt, "fro");
+          localsymm[0] *= localsymm[0];
+          localsymm[1] *= localsymm[1];
+          this->m_reducer.add(localsymm, globalsymm, 2);
+        }
 #ifdef BUILD_SPARSE
-        this->computeError(iter);
+        this->computeError(iter, this->prevHtH);
+        this->m_reducer.allreduce(MPI_COMM_WORLD);
 #else
-        this->computeError2(iter);
+        if (this->symm_reg() > 0) {
+          // WtAij carries the symmetric regularization
+          this->computeError2(iter);
+        } else if (m_errcheck > 0 && iter % m_errcheck == 0) {
+          this->computeError(iter, this->errHtH);
+          double traced = this->objective_err;
+          this->computeError2(iter);
+          PRINTROOT("it=" << iter << "::errcheck::traced::" << traced
+                          << "::exact::" << this->objective_err
+                          << "::drift::"
+                          << std::abs(traced - this->objective_err) /
+                                 this->m_globalsqnormA);
+        } else {
+          this->computeError(iter, this->errHtH);
+        }
 #endif
         std::string outfullName = relative_error_dir+"relerr_at_k"+std::to_string(this->k);
         PRINTROOT("it=" << iter << "::algo::" << this->m_algorithm << "::k::"
@@ -625,29 +988,18 @@ than in dense x sparse. Keeping current version for performance reasons.
         }
         // Compute the difference between factor matrices
         if (this->symm_reg() > 0) {
-          double localdiff = arma::norm(this->Wt-this->crossFac, "fro");
-          double globaldiff = 0.0;
-
-          // Compute global difference
-          localdiff = localdiff * localdiff;
-          MPI_Allreduce(&localdiff, &globaldiff, 1,
-              MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-
-          double localWnorm = arma::norm(this->Wt, "fro");
-          double globalWnorm = 0.0;
-
-          // Compute global W norm
-          localWnorm = localWnorm * localWnorm;
-          MPI_Allreduce(&localWnorm, &globalWnorm, 1,
-              MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-
+          double globaldiff = globalsymm[0];
+          double globalWnorm = globalsymm[1];
           PRINTROOT("it=" << iter << "::symmdiff::" << globaldiff
                     << "::reldiff::" << sqrt(globaldiff / globalWnorm));
         }
+        if (m_extrapolate) adaptExtrapolation(iter);
       }
       PRINTROOT("completed it=" << iter
                                 << "::taken::" << this->time_stats.duration());
     }  // end for loop
+    this->time_stats.trace_stop();
+    DistTracer::instance().iteration(-1);
     MPI_Barrier(MPI_COMM_WORLD);
     this->reportTime(this->time_stats.duration(), "total_d");
     this->reportTime(this->time_stats.communication_duration(), "total_comm");
@@ -659,6 +1011,14 @@ than in dense x sparse. Keeping current version for performance reasons.
     this->reportTime(this->time_stats.gram_duration(), "total_gram");
     this->reportTime(this->time_stats.mm_duration(), "total_mm");
     this->reportTime(this->time_stats.nnls_duration(), "total_nnls");
+    if (this->m_algorithm == ANLSBPP || this->m_algorithm == NESTEROV) {
+      this->reportTime(this->time_stats.nnls_fallbacks(),
+                       "total_nnls_fallbacks");
+    }
+    if (m_inneriter > 1 || this->m_algorithm == AOADMM) {
+      this->reportTime(this->time_stats.inner_sweeps(), "total_inner_sweeps");
+    }
+    if (m_extrapolate) this->reportTime(m_restarts, "total_restarts");
     if (this->symm_reg() > 0) {
       this->reportTime(this->time_stats.sendrecv_duration(), "total_sendrecv");
     }
@@ -668,6 +1028,8 @@ than in dense x sparse. Keeping current version for performance reasons.
       this->reportTime(this->time_stats.err_compute_duration(),
                        "total_err_communication");
     }
+    this->flushReportedTimes();
+    this->reportTrace();
   }
 
   /**
@@ -680,37 +1042,46 @@ than in dense x sparse. Keeping current version for performance reasons.
    * each process owns H is of size \f${globaln}{p} \times k \f$
    * compute WtAij*H and do an MPI_ALL reduce to get the kxk matrix.
    * every process local computation
+   * The local kxk matrix is queued by queueError and reduced together
+   * with HtH, once WtAij of the iteration is known.
+   * @param[in] H the sparse build passes the H of the previous iteration,
+   *            the dense build the new H whose error computeError2 gives
    */
-
-  void computeError(const int it) {
+  void queueError(const MAT &H) {
     MPITIC;  // computeerror
-    this->localWtAijH = this->WtAij * this->prevH;
+    this->localWtAijH = this->WtAij * H;
 #ifdef MPI_VERBOSE
-    DISTPRINTINFO("::it=" << it << PRINTMAT(this->WtAij));
-    DISTPRINTINFO("::it=" << it << PRINTMAT(this->localWtAijH));
-    DISTPRINTINFO("::it=" << it << PRINTMAT(this->prevH));
-    PRINTROOT("::it=" << it << PRINTMAT(this->WtW));
-    PRINTROOT("::it=" << it << PRINTMAT(this->prevHtH));
+    DISTPRINTINFO(PRINTMAT(this->WtAij));
+    DISTPRINTINFO(PRINTMAT(this->localWtAijH));
+    DISTPRINTINFO(PRINTMAT(this->prevH));
 #endif
-    double temp = MPITOC;  // computererror
+    double temp = MPITOCTRACE("err::compute", 0);  // computererror
     this->time_stats.err_compute_duration(temp);
-    MPITIC;  // coommunication error
-    MPI_Allreduce(this->localWtAijH.memptr(), this->WtAijH.memptr(),
-                  this->k * this->k, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    temp = MPITOC;  // communication error
+    this->m_reducer.add(this->localWtAijH.memptr(), this->WtAijH.memptr(),
+                        this->k * this->k);
+  }
+
+  /**
+   * normA - 2 tr(WtAijH) + tr(WtW HtH) with the Grams taken before
+   * applyReg, the regularization is no part of the residual.
+   * @param[in] HtH plain Gram of the H passed to queueError
+   */
+  void computeError(const int it, const MAT &HtH) {
 #ifdef MPI_VERBOSE
+    PRINTROOT("::it=" << it << PRINTMAT(this->errWtW));
+    PRINTROOT("::it=" << it << PRINTMAT(HtH));
     DISTPRINTINFO(PRINTMAT(WtAijH));
 #endif
-    this->time_stats.err_communication_duration(temp);
     double tWtAijh = trace(this->WtAijH);
-    double tWtWHtH = trace(this->WtW * this->prevHtH);
+    double tWtWHtH = trace(this->errWtW * HtH);
     PRINTROOT("::it=" << it << "normA::" << this->m_globalsqnormA
                       << "::tWtAijH::" << 2 * tWtAijh
                       << "::tWtWHtH::" << tWtWHtH);
     this->objective_err = this->m_globalsqnormA - 2 * tWtAijh + tWtWHtH;
   }
   /*
-   * Compute error the old-fashioned way
+   * Compute error the old-fashioned way. Forms the m x n residual, so the
+   * dense build only runs it for set_errcheck and symmetric regularization.
    */
   void computeError2(const int it) {
     double local_sqerror = 0.0;
@@ -718,23 +1089,165 @@ than in dense x sparse. Keeping current version for performance reasons.
     MPITIC;
     // DISTPRINTINFO("::norm(Wi,fro)::" << norm(this->Wit, "fro") <<
     // "::norm(Hjt, fro)::" << norm(this->Hjt, "fro"));
-    this->Wi = this->Wit.t();
-    errMtx = this->Wi * this->Hjt;
+    if (m_nodeWit.active() || m_nodeHjt.active()) {
+      const AMAT Wshared(m_nodeWit.active() ? m_nodeWit.memptr()
+                                           : this->Wit.memptr(),
+                        this->perk, this->m, false, true);
+      const AMAT Hshared(m_nodeHjt.active() ? m_nodeHjt.memptr()
+                                           : this->Hjt.memptr(),
+                        this->perk, this->n, false, true);
+      errMtx = Wshared.t() * Hshared;
+    } else {
+      this->Wi = this->Wit.t();
+      errMtx = this->Wi * this->Hjt;
+    }
     A_errMtx = this->A - errMtx;
     local_sqerror = norm(A_errMtx, "fro");
     local_sqerror *= local_sqerror;
-    double temp = MPITOC;
+    double temp = MPITOCTRACE("err::compute", 0);
     this->time_stats.err_compute_duration(temp);
     // DISTPRINTINFO("::it=" << it << "::local_sqerror::" << local_sqerror);
     MPITIC;
-    MPI_Allreduce(&local_sqerror, &this->objective_err, 1, MPI_DOUBLE, MPI_SUM,
-                  MPI_COMM_WORLD);
-    temp = MPITOC;
-    this->time_stats.err_communication_duration(temp);
+    this->m_reducer.add(&local_sqerror, &this->objective_err, 1);
+    this->m_reducer.allreduce(MPI_COMM_WORLD);
+    temp = MPITOCTRACE("err::allreduce", 8.0);
+    this->time_stats.err_communication_duration(temp, 8.0);
+  }
+
+  /**
+   * X = [X + beta (X - Xlast)]_+ with the X of the inner solver saved in
+   * Xlast. The first two iterations only save X, the step from the initial
+   * factors is no direction to follow and the restart needs the error of
+   * a plain iteration to compare with. The projection keeps X positive
+   * like the clamp of HALS, so no column of the extrapolated factor
+   * vanishes.
+   */
+  void extrapolate(unsigned int iter, MAT *X, MAT *Xlast) {
+    if (iter < 2) {
+      *Xlast = *X;
+      return;
+    }
+    MAT Xhat = (1 + m_beta) * *X - m_beta * *Xlast;
+    fixNumericalError<MAT>(&Xhat, EPSILON_1EMINUS16, EPSILON_1EMINUS16);
+    *Xlast = *X;
+    *X = Xhat;
+  }
+
+  /**
+   * The extrapolation parameter of Ang and Gillis, Neural Computation
+   * 31(2), 2019. While the error decreases beta grows by 1.05 up to a cap,
+   * which itself grows by 1.01 up to 1. When the error increases the
+   * iteration restarts from the W and H of the inner solver, the cap drops
+   * to beta and beta by 1.5. Every rank sees the same reduced error and
+   * takes the same decision. The sparse error of an iteration is the one of
+   * the factors the previous one ended with, so there the restart lags
+   * one iteration.
+   */
+  void adaptExtrapolation(unsigned int iter) {
+    double err = this->objective_err;
+    if (iter > 1 && err > m_lasterr) {
+      this->W = m_Wlast;
+      this->H = m_Hlast;
+      this->Wt = this->W.t();
+      this->Ht = this->H.t();
+#ifdef BUILD_SPARSE
+      // the sparse error of the next iteration needs the Gram of H
+      this->distInnerProduct(this->H, &this->errHtH);
+#endif
+      m_betamax = m_beta;
+      m_beta /= 1.5;
+      m_restarts++;
+      PRINTROOT("it=" << iter << "::extrapolation restart::beta::" << m_beta);
+    } else if (iter > 1) {
+      m_beta = std::min(m_betamax, 1.05 * m_beta);
+      m_betamax = std::min(1.0, 1.01 * m_betamax);
+    }
+    m_lasterr = err;
   }
 
   // Set the LUC inner iterations for iterative LUC
   void set_luciters(int max_luciters) {}
+
+  // Set the inner iterations and tolerance of AO-ADMM
+  void set_admm(int, double) {}
+
+  /**
+   * The dense error is evaluated from WtAij, WtW and HtH with the trace
+   * identity like the sparse one. Every errcheck-th iteration the residual
+   * is formed as well, its error is reported and the drift of the trace
+   * identity printed. 0 never forms the residual. The residual is formed
+   * from Wit and Hjt, which only hold the last k-block, so the check is
+   * disabled when num_k_blocks > 1. Call before computeNMF.
+   */
+  void set_errcheck(int errcheck) {
+    m_errcheck = num_k_blocks > 1 ? 0 : errcheck;
+    if (errcheck > 0 && num_k_blocks > 1)
+      PRINTROOT("errcheck::disabled::num_k_blocks::" << num_k_blocks);
+  }
+
+  /**
+   * Sweeps of HALS and MU over W and H per distWtA and distAH, at most
+   * inneriter, stopped early by the rule of innerConverged. The extra
+   * sweeps only cost k x k work per row of the factor, so they trade
+   * local flops for fewer of the 2D products. 1 is the plain algorithm.
+   * The other algorithms ignore it. Call before computeNMF.
+   */
+  void set_inneriter(int inneriter, double innertol) {
+    m_inneriter = inneriter > 1 ? inneriter : 1;
+    m_innertol = innertol;
+  }
+
+  /**
+   * Extrapolate W and H between the outer iterations and restart when the
+   * error increases, see adaptExtrapolation. The updates of ANLS/BPP and
+   * HALS are the inner solver, the extrapolated factors enter the Grams
+   * and the products with A in place of the plain ones, so an iteration
+   * costs the same distributed products. Turns on the error computation.
+   * Call before computeNMF.
+   */
+  void set_extrapolate(bool extrapolate) { m_extrapolate = extrapolate; }
+
+  /**
+   * Overlap the communication of the k blocks of distWtA and distAH with
+   * the matrix multiplies. With a single k block there is nothing to
+   * overlap and the blocking collectives are kept. The overlapped stages
+   * are timed without the barrier of __WITH__BARRIER__TIMING__.
+   */
+  void set_overlap(bool overlap) {
+#ifndef USE_PACOSS
+    m_overlap = overlap && num_k_blocks > 1;
+    if (m_overlap) {
+      Ht_blk_nxt.zeros(this->perk, this->H.n_rows);
+      bindBuffer(WS_HJT_NXT);
+      bindBuffer(WS_AIJHJT_NXT);
+      AHtij_blk_nxt.zeros(this->perk, this->W.n_rows);
+      Wt_blk_nxt.zeros(this->perk, this->W.n_rows);
+      bindBuffer(WS_WIT_NXT);
+      bindBuffer(WS_WITAIJ_NXT);
+      WtAij_blk_nxt.zeros(this->perk, this->H.n_rows);
+    }
+#endif
+  }
+
+  /**
+   * Gather Wit and Hjt once per node into shared memory instead of into
+   * a private copy on every rank. The per rank copies are released. Not
+   * combined with --overlap, whose second buffers would need a second
+   * window per factor. Collective over the grid.
+   */
+  void set_nodegather(bool nodegather) {
+#ifndef USE_PACOSS
+    if (!nodegather || m_overlap) return;
+    if (m_nodeWit.setup(this->m_mpicomm.commSubs()[1], gatherWtAcnts,
+                        gatherWtAdisp))
+      Wit.reset();
+    if (m_nodeHjt.setup(this->m_mpicomm.commSubs()[0], gatherAHcnts,
+                        gatherAHdisp))
+      Hjt.reset();
+    PRINTROOT("nodegather::Wit::" << m_nodeWit.active()
+                                  << "::Hjt::" << m_nodeHjt.active());
+#endif
+  }
 };
 
 }  // namespace planc
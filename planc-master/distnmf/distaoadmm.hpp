@@ -3,6 +3,11 @@
 #ifndef DISTNMF_DISTAOADMM_HPP_
 #define DISTNMF_DISTAOADMM_HPP_
 
+#ifdef MKL_FOUND
+#include <mkl.h>
+#else
+#include <lapacke.h>
+#endif
 #include "distnmf/aunmf.hpp"
 /**
  * Provides the updateW and updateH for the
@@ -14,10 +19,8 @@ namespace planc {
 template <class INPUTMATTYPE>
 class DistAOADMM : public DistAUNMF<INPUTMATTYPE> {
  private:
-  MAT tempHtH;
-  MAT tempWtW;
-  MAT tempAHtij;
-  MAT tempWtAij;
+  MAT tempHtH;  /// HtH + alpha I, factored in place
+  MAT tempWtW;  /// WtW + beta I, factored in place
   ROWVEC localWnorm;
   ROWVEC Wnorm;
 
@@ -28,14 +31,10 @@ class DistAOADMM : public DistAUNMF<INPUTMATTYPE> {
   MAT Vt;
 
   // Auxiliary Variables
-  MAT Haux;
   MAT Htaux;
-  MAT Waux;
   MAT Wtaux;
 
-  // Cholesky Variables
-  MAT L;
-  MAT Lt;
+  // Previous iterates of the inner loop
   MAT tempHtaux;
   MAT tempWtaux;
 
@@ -46,8 +45,6 @@ class DistAOADMM : public DistAUNMF<INPUTMATTYPE> {
   void allocateMatrices() {
     this->tempHtH.zeros(this->k, this->k);
     this->tempWtW.zeros(this->k, this->k);
-    this->tempAHtij.zeros(size(this->AHtij));
-    this->tempWtAij.zeros(size(this->WtAij));
 
     // Normalise W, H
     this->W = normalise(this->W, 2, 1);
@@ -62,10 +59,8 @@ class DistAOADMM : public DistAUNMF<INPUTMATTYPE> {
     this->Ut = U.t();
 
     // Auxiliary Variables
-    this->Waux.zeros(size(this->W));
-    this->Wtaux = Waux.t();
-    this->Haux.zeros(size(this->H));
-    this->Htaux = Haux.t();
+    this->Wtaux.zeros(size(this->Wt));
+    this->Htaux.zeros(size(this->Ht));
 
     // Hyperparameters
     alpha = 0.0;
@@ -73,101 +68,86 @@ class DistAOADMM : public DistAUNMF<INPUTMATTYPE> {
     tolerance = 0.01;
     admm_iter = 5;
 
-    this->L.zeros(this->k, this->k);
-    this->Lt = this->L.t();
     this->tempWtaux.zeros(size(this->Wt));
     this->tempHtaux.zeros(size(this->Ht));
   }
 
- protected:
   /**
-   * Inexact ADMM to update W given AHtij and HtH
-   * AHtij is of size \f$ k \times \frac{globalm}/{p}\f$.
-   * this->W is of size \f$\frac{globalm}{p} \times k \f$
-   * this->HtH is of size kxk
+   * Inexact ADMM for one factor in the transposed layout, Xt of size
+   * k x local rows. Gram + rho I is factored once with potrf into G and
+   * every iteration solves the whole block of right hand sides in place
+   * with one potrs. The primal residual \f$\|X_t - X_{aux}\|\f$, the
+   * change of Xt and the norms of Xt and Ut they are compared with are
+   * reduced with one allreduce. Stops after admm_iter iterations or once
+   * both residuals are below tolerance of their norm.
+   * @param[in] gram k x k Gram of the fixed factor
+   * @param[in] AXt product of A with the fixed factor, same size as Xt
+   * @param[in,out] Xt factor, Ut scaled dual variable
+   * @param[out] G, Xtaux, Xtprev workspace of the size of gram and Xt
    */
-  void updateW() {
-    // Calculate modified Gram Matrix
-    // tempHtH = arma::conv_to<MAT >::from(this->HtH);
-    tempHtH = this->HtH;
-    alpha = trace(tempHtH) / this->k;
-    alpha = alpha > 0 ? alpha : 0.01;
-    tempHtH.diag() += alpha;
-    L = arma::conv_to<MAT>::from(arma::chol(tempHtH, "lower"));
-    Lt = L.t();
-
-    bool stop_iter = false;
-
-    // Start ADMM loop from here
-    for (int i = 0; i < admm_iter && !stop_iter; i++) {
-      this->Waux = this->W;
-
-      // tempAHtij = arma::conv_to<MAT >::from(this->AHtij);
-      tempAHtij = this->AHtij;
-      tempAHtij = tempAHtij + (alpha * (this->Wt + this->Ut));
-
-      // Solve least squares
-      // tempWtaux = arma::conv_to<MAT >::from(
-      tempWtaux = arma::solve(arma::trimatl(L), tempAHtij);
-      Wtaux =
-          arma::conv_to<MAT>::from(arma::solve(arma::trimatu(Lt), tempWtaux));
-
-      // Update W
-      // this->Wt = arma::conv_to<MAT >::from(Wtaux);
-      this->Wt = Wtaux;
+  void admm(const MAT &gram, const MAT &AXt, double rho, MAT *G, MAT *Xt,
+            MAT *Ut, MAT *Xtaux, MAT *Xtprev) {
+    *G = gram;
+    G->diag() += rho;
+    int info = LAPACKE_dpotrf(LAPACK_COL_MAJOR, 'L', this->k, G->memptr(),
+                              this->k);
+    if (info != 0) {
+      // not positive definite, solve with the unfactored matrix
+      *G = gram;
+      G->diag() += rho;
+    }
+    for (int i = 0; i < admm_iter; i++) {
+      *Xtprev = *Xt;
+      *Xtaux = AXt + rho * (*Xt + *Ut);
+      if (info == 0) {
+        LAPACKE_dpotrs(LAPACK_COL_MAJOR, 'L', this->k, Xtaux->n_cols,
+                       G->memptr(), this->k, Xtaux->memptr(), this->k);
+      } else {
+        *Xtaux = arma::solve(*G, *Xtaux);
+      }
       // Uncomment if numerical issues are seen
-      // fixNumericalError<MAT>(&(this->Wt), EPSILON_1EMINUS16, 0.0);
-      this->Wt = this->Wt - this->Ut;
-      this->Wt.for_each(
-          [](MAT::elem_type &val) { val = val > 0.0 ? val : 0.0; });
-      this->W = this->Wt.t();
+      // fixNumericalError<MAT>(Xtaux, EPSILON_1EMINUS16, 0.0);
+      *Xt = *Xtaux - *Ut;
+      Xt->for_each([](MAT::elem_type &val) { val = val > 0.0 ? val : 0.0; });
 
       // Update Dual Variable
-      this->Ut = this->Ut + this->Wt - this->Wtaux;
-      this->U = this->Ut.t();
+      *Ut += *Xt - *Xtaux;
+      this->time_stats.inner_sweeps(1);
 
       // Check stopping criteria
-      double r = norm(this->Wt - this->Wtaux, "fro");
-      r *= r;
-      double globalr;
+      double local[4], global[4];
+      local[0] = norm(*Xt - *Xtaux, "fro");
+      local[1] = norm(*Xt - *Xtprev, "fro");
+      local[2] = norm(*Xt, "fro");
+      local[3] = norm(*Ut, "fro");
+      for (int j = 0; j < 4; j++) local[j] *= local[j];
       mpitic();
-      MPI_Allreduce(&r, &globalr, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-      double temp = mpitoc();
+      this->m_reducer.add(local, global, 4);
+      this->m_reducer.allreduce(MPI_COMM_WORLD);
+      double temp = mpitoc("ADMM::allreduce", 32.0);
       this->time_stats.communication_duration(temp);
-      this->time_stats.allreduce_duration(temp);
-      globalr = sqrt(globalr);
-
-      double s = norm(this->W - this->Waux, "fro");
-      s *= s;
-      double globals;
-      mpitic();
-      MPI_Allreduce(&s, &globals, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-      temp = mpitoc();
-      globals = sqrt(globals);
-
-      double normW = norm(this->W, "fro");
-      normW *= normW;
-      double globalnormW;
-      mpitic();
-      MPI_Allreduce(&normW, &globalnormW, 1, MPI_DOUBLE, MPI_SUM,
-                    MPI_COMM_WORLD);
-      temp = mpitoc();
-      globalnormW = sqrt(globalnormW);
-
-      double normU = norm(this->U, "fro");
-      normU *= normU;
-      double globalnormU;
-      mpitic();
-      MPI_Allreduce(&normU, &globalnormU, 1, MPI_DOUBLE, MPI_SUM,
-                    MPI_COMM_WORLD);
-      temp = mpitoc();
-      globalnormU = sqrt(globalnormU);
-
-      if (globalr < (tolerance * globalnormW) &&
-          globals < (tolerance * globalnormU))
-        stop_iter = true;
+      this->time_stats.allreduce_duration(temp, 32.0);
+      if (sqrt(global[0]) < tolerance * sqrt(global[2]) &&
+          sqrt(global[1]) < tolerance * sqrt(global[3]))
+        break;
     }
   }
+
+ protected:
+  /**
+   * Inexact ADMM to update W given AHtij and HtH
+   * AHtij is of size \f$ k \times \frac{globalm}/{p}\f$.
+   * this->W is of size \f$\frac{globalm}{p} \times k \f$
+   * this->HtH is of size kxk
+   */
+  void updateW() {
+    alpha = trace(this->HtH) / this->k;
+    alpha = alpha > 0 ? alpha : 0.01;
+    admm(this->HtH, this->AHtij, alpha, &tempHtH, &this->Wt, &this->Ut,
+         &this->Wtaux, &tempWtaux);
+    this->W = this->Wt.t();
+    this->U = this->Ut.t();
+  }
   /**
    * Inexact ADMM to update H given WtAij and WtW
    * WtAij is of size \f$k \times \frac{globaln}{p} \f$
@@ -175,85 +155,12 @@ class DistAOADMM : public DistAUNMF<INPUTMATTYPE> {
    * this->WtW is of size kxk
    */
   void updateH() {
-    // Calculate the Gram Matrix
-    tempWtW = arma::conv_to<MAT>::from(this->WtW);
-    beta = trace(tempWtW) / this->k;
+    beta = trace(this->WtW) / this->k;
     beta = beta > 0 ? beta : 0.01;
-    tempWtW.diag() += beta;
-    // L = arma::conv_to<MAT >::from(arma::chol(tempWtW, "lower"));
-    L = arma::chol(tempWtW, "lower");
-    Lt = L.t();
-
-    bool stop_iter = false;
-
-    // Start ADMM loop from here
-    for (int i = 0; i < admm_iter && !stop_iter; i++) {
-      this->Haux = this->H;
-
-      // tempWtAij = arma::conv_to<MAT >::from(this->WtAij);
-      tempWtAij = this->WtAij;
-      tempWtAij = tempWtAij + (beta * (this->Ht + this->Vt));
-
-      // Solve least squares
-      // tempHtaux = arma::conv_to<MAT >::from(
-      tempHtaux = arma::solve(arma::trimatl(L), tempWtAij);
-      // Htaux = arma::conv_to<MAT >::from(
-      Htaux = arma::solve(arma::trimatu(Lt), tempHtaux);
-      // Update H
-      // this->Ht = arma::conv_to<MAT >::from(Htaux);
-      this->Ht = Htaux;
-      // Uncomment if numerical issues are seen
-      // fixNumericalError<MAT>(&(this->Ht), EPSILON_1EMINUS16, 0.0);
-      this->Ht = this->Ht - this->Vt;
-      this->Ht.for_each(
-          [](MAT::elem_type &val) { val = val > 0.0 ? val : 0.0; });
-      this->H = this->Ht.t();
-
-      // Update Dual Variable
-      this->Vt = this->Vt + this->Ht - this->Htaux;
-      this->V = this->Vt.t();
-
-      // Check stopping criteria
-      double r = norm(this->Ht - this->Htaux, "fro");
-      r *= r;
-      double globalr;
-      mpitic();
-      MPI_Allreduce(&r, &globalr, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-      double temp = mpitoc();
-      this->time_stats.communication_duration(temp);
-      this->time_stats.allreduce_duration(temp);
-      globalr = sqrt(globalr);
-
-      double s = norm(this->H - this->Haux, "fro");
-      s *= s;
-      double globals;
-      mpitic();
-      MPI_Allreduce(&s, &globals, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-      temp = mpitoc();
-      globals = sqrt(globals);
-
-      double normH = norm(this->H, "fro");
-      normH *= normH;
-      double globalnormH;
-      mpitic();
-      MPI_Allreduce(&normH, &globalnormH, 1, MPI_DOUBLE, MPI_SUM,
-                    MPI_COMM_WORLD);
-      temp = mpitoc();
-      globalnormH = sqrt(globalnormH);
-
-      double normV = norm(this->V, "fro");
-      normV *= normV;
-      double globalnormV;
-      mpitic();
-      MPI_Allreduce(&normV, &globalnormV, 1, MPI_DOUBLE, MPI_SUM,
-                    MPI_COMM_WORLD);
-      temp = mpitoc();
-      globalnormV = sqrt(globalnormV);
-
-      if (globalr < (tolerance * globalnormH) &&
-          globals < (tolerance * globalnormV))
-        stop_iter = true;
-    }
+    admm(this->WtW, this->WtAij, beta, &tempWtW, &this->Ht, &this->Vt,
+         &this->Htaux, &tempHtaux);
+    this->H = this->Ht.t();
+    this->V = this->Vt.t();
   }
 
  public:
@@ -268,12 +175,19 @@ class DistAOADMM : public DistAUNMF<INPUTMATTYPE> {
     PRINTROOT("DistAOADMM() constructor successful");
   }
 
+  /**
+   * At most admmiter ADMM iterations per factor update, fewer once the
+   * residuals fall below admmtol, and at least one. Call before computeNMF.
+   */
+  void set_admm(int admmiter, double admmtol) {
+    admm_iter = admmiter > 1 ? admmiter : 1;
+    tolerance = admmtol;
+  }
+
   ~DistAOADMM() {
     /*
     tempHtH.clear();
     tempWtW.clear();
-    tempAHtij.clear();
-    tempWtAij.clear();
     */
   }
 };  // class DistAOADMM2D
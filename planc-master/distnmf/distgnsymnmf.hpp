@@ -417,6 +417,7 @@ class DistGNSym : public DistAUNMF<INPUTMATTYPE> {
     this->reportTime(this->time_stats.gradient_duration(), "total_gradient");
     this->reportTime(this->time_stats.cg_duration(), "total_cg");
     this->reportTime(this->time_stats.projection_duration(), "total_proj");
+    this->flushReportedTimes();
 
     // Print counters
     PRINTROOT("cg_grams::" << cg_grams);
@@ -21,73 +21,103 @@ class DistHALS : public DistAUNMF<INPUTMATTYPE> {
    * this->HtH is of size kxk
    * Eq 14(a) page 7 of JGO paper
    * \f$W(:,i)=[W(:,i) + (AH(:,i)-WH^TH(:,i))/H^TH(i,i)]_+\f$
-   * column normalize W_i
+   * The columns are normalized together after the sweeps, see normalizeW.
    */
   void updateW() {
-    for (unsigned int i = 0; i < this->k; i++) {
-      // W(:,i) = max(W(:,i) * HHt_reg(i,i) + AHt(:,i) - W *
-      // HHt_reg(:,i),epsilon);
-      VEC updWi = this->W.col(i) * this->HtH(i, i) +
-                  ((this->AHtij.row(i)).t() - this->W * this->HtH.col(i));
+    double first = 0;
+    for (unsigned int sweep = 0;; sweep++) {
+      double change = 0;
+      for (unsigned int i = 0; i < this->k; i++) {
+        // W(:,i) = max(W(:,i) + (AHt(:,i) - W * HHt_reg(:,i)) /
+        // HHt_reg(i,i), epsilon);
+        VEC updWi = this->W.col(i) +
+                    ((this->AHtij.row(i)).t() - this->W * this->HtH.col(i)) /
+                        this->HtH(i, i);
 #ifdef MPI_VERBOSE
-      DISTPRINTINFO("b4 fixNumericalError::" << endl << updWi);
+        DISTPRINTINFO("b4 fixNumericalError::" << endl << updWi);
 #endif  // ifdef MPI_VERBOSE
-      fixNumericalError<VEC>(&updWi, EPSILON_1EMINUS16, EPSILON_1EMINUS16);
+        fixNumericalError<VEC>(&updWi, EPSILON_1EMINUS16, EPSILON_1EMINUS16);
 #ifdef MPI_VERBOSE
-      DISTPRINTINFO("after fixNumericalError::" << endl << updWi);
+        DISTPRINTINFO("after fixNumericalError::" << endl << updWi);
 #endif  // ifdef MPI_VERBOSE
-
-      // W(:,i) = W(:,i)/norm(W(:,i));
-      double normWi = arma::norm(updWi, 2);
-      normWi *= normWi;
-      double globalnormWi;
-      mpitic();
-      MPI_Allreduce(&normWi, &globalnormWi, 1, MPI_DOUBLE, MPI_SUM,
-                    MPI_COMM_WORLD);
-      double temp = mpitoc();
-      this->time_stats.communication_duration(temp);
-      this->time_stats.allreduce_duration(temp);
-
-      if (globalnormWi > 0) {
-        this->W.col(i) = updWi / sqrt(globalnormWi);
+        change += arma::accu(arma::square(updWi - this->W.col(i)));
+        this->W.col(i) = updWi;
       }
+      if (this->innerConverged(sweep, change, &first)) break;
     }
+    normalizeW();
     this->Wt = this->W.t();
   }
 
+  /**
+   * W(:,i) = W(:,i)/norm(W(:,i)) for all i with one allreduce of the k
+   * squared norms. Normalizing a column during the sweep and scaling the
+   * matching column of H by its norm leaves WH^T and so the updates of
+   * the later columns unchanged, so the normalization can wait for the
+   * end of the sweep. H and Ht get that compensating scale. With
+   * symmetric regularization H has to stay close to W and is not scaled.
+   */
+  void normalizeW() {
+    VEC localnorms = arma::sum(arma::square(this->W), 0).t();
+    VEC globalnorms(this->k);
+    mpitic();
+    MPI_Allreduce(localnorms.memptr(), globalnorms.memptr(), this->k,
+                  MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    double temp = mpitoc("HALS::allreduce", 8.0 * this->k);
+    this->time_stats.communication_duration(temp);
+    this->time_stats.allreduce_duration(temp, 8.0 * this->k);
+    bool compensate = this->symm_reg() <= 0;
+    for (unsigned int i = 0; i < this->k; i++) {
+      if (globalnorms(i) <= 0) continue;
+      double normWi = sqrt(globalnorms(i));
+      this->W.col(i) /= normWi;
+      if (compensate) {
+        this->H.col(i) *= normWi;
+        this->Ht.row(i) *= normWi;
+        // extrapolation direction and restart point follow H
+        if (this->m_extrapolate) this->m_Hlast.col(i) *= normWi;
+#ifdef BUILD_SPARSE
+        // the sparse error of the next iteration takes errHtH as the Gram
+        // of H, the dense error of this one still needs the unscaled one
+        this->errHtH.row(i) *= normWi;
+        this->errHtH.col(i) *= normWi;
+#endif
+      }
+    }
+  }
+
   /**
    * WtAij is of size \f$k \times \frac{globaln}{p} \f$
    * this->H is of size \f$ \frac{globaln}{p} \times k\f$
    * this->WtW is of size kxk
    * Eq 14(b) page 7 of JGO paper
-   * \f$ H(:,i) = H(:,i) + WtAij(:,i) - HW^TW(:,i)\f$
+   * \f$ H(:,i) = [H(:,i) + (WtAij(:,i) - HW^TW(:,i))/W^TW(i,i)]_+\f$
    * Here ij is the element of H matrix.
+   * The update is clamped at epsilon, so no column of H vanishes. The
+   * step keeps the divisor W^TW(i,i): it is 1 right after normalizeW, but
+   * not once -a 5 has extrapolated W or regularization is added to W^TW.
    */
   void updateH() {
-    for (unsigned int i = 0; i < this->k; i++) {
-      // H(i,:) = max(H(i,:) + WtA(i,:) - WtW_reg(i,:) * H,epsilon);
-      VEC updHi = this->H.col(i) +
-                  ((this->WtAij.row(i)).t() - this->H * this->WtW.col(i));
+    double first = 0;
+    for (unsigned int sweep = 0;; sweep++) {
+      double change = 0;
+      for (unsigned int i = 0; i < this->k; i++) {
+        // H(i,:) = max(H(i,:) + (WtA(i,:) - WtW_reg(i,:) * H) /
+        // WtW_reg(i,i), epsilon);
+        VEC updHi = this->H.col(i) +
+                    ((this->WtAij.row(i)).t() - this->H * this->WtW.col(i)) /
+                        this->WtW(i, i);
 #ifdef MPI_VERBOSE
-      DISTPRINTINFO("b4 fixNumericalError::" << endl << updHi);
+        DISTPRINTINFO("b4 fixNumericalError::" << endl << updHi);
 #endif  // ifdef MPI_VERBOSE
-      fixNumericalError<VEC>(&updHi, EPSILON_1EMINUS16, EPSILON_1EMINUS16);
+        fixNumericalError<VEC>(&updHi, EPSILON_1EMINUS16, EPSILON_1EMINUS16);
 #ifdef MPI_VERBOSE
-      DISTPRINTINFO("after fixNumericalError::" << endl << updHi);
+        DISTPRINTINFO("after fixNumericalError::" << endl << updHi);
 #endif  // ifdef MPI_VERBOSE
-      double normHi = arma::norm(updHi, 2);
-      normHi *= normHi;
-      double globalnormHi;
-      mpitic();
-      MPI_Allreduce(&normHi, &globalnormHi, 1, MPI_DOUBLE, MPI_SUM,
-                    MPI_COMM_WORLD);
-      double temp = mpitoc();
-      this->time_stats.communication_duration(temp);
-      this->time_stats.allreduce_duration(temp);
-
-      if (globalnormHi > 0) {
+        change += arma::accu(arma::square(updHi - this->H.col(i)));
         this->H.col(i) = updHi;
       }
+      if (this->innerConverged(sweep, change, &first)) break;
     }
     this->Ht = this->H.t();
   }
@@ -0,0 +1,91 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file keeps the invariants of the local input block across NMF runs.
+*/
+
+#ifndef DISTNMF_DISTINPUTCONTEXT_HPP_
+#define DISTNMF_DISTINPUTCONTEXT_HPP_
+
+#include <mpi.h>
+#include <cmath>
+#include "common/utils.h"
+#include "distnmf/mpicomm.hpp"
+
+namespace planc {
+
+/**
+ * Process wide record of the input block the NMF runs of a sweep factorize.
+ * The driver registers the global dimensions once and the squared norm of
+ * the block every time it changes it, typically as a by-product of the
+ * perturbation. A DistNMF constructed on the registered block then takes
+ * the norm and the dimensions from here instead of sweeping over the block
+ * and reducing them again. The block is identified by its address and
+ * size, so the driver has to call update() after every modification of the
+ * block and clear() before the block goes away.
+ */
+class DistInputContext {
+ private:
+  const void *m_input;   /// registered block, NULL if none
+  UWORD m_m, m_n;        /// local size of the block
+  UWORD m_globalm, m_globaln;
+  double m_localsqnorm;
+  double m_globalsqnorm;
+
+  DistInputContext()
+      : m_input(NULL), m_m(0), m_n(0), m_globalm(0), m_globaln(0),
+        m_localsqnorm(0), m_globalsqnorm(0) {}
+
+ public:
+  static DistInputContext &instance() {
+    static DistInputContext context;
+    return context;
+  }
+
+  /**
+   * Registers the local size of the block and reduces the global size over
+   * the grid. Collective over the row and column communicators.
+   */
+  void dims(UWORD m, UWORD n, const MPICommunicator &mpicomm) {
+    int localm = m, localn = n, globalm, globaln;
+    MPI_Allreduce(&localm, &globalm, 1, MPI_INT, MPI_SUM,
+                  mpicomm.commSubs()[0]);
+    MPI_Allreduce(&localn, &globaln, 1, MPI_INT, MPI_SUM,
+                  mpicomm.commSubs()[1]);
+    m_m = m;
+    m_n = n;
+    m_globalm = globalm;
+    m_globaln = globaln;
+    m_input = NULL;
+  }
+
+  /**
+   * Registers new contents of the block. One MPI_Allreduce over
+   * MPI_COMM_WORLD, the same the constructor of DistNMF would issue.
+   * @param[in] input address of the local block of size dims()
+   * @param[in] localsqnorm squared frobenius norm of the local block
+   */
+  void update(const void *input, double localsqnorm) {
+    m_localsqnorm = localsqnorm;
+    MPI_Allreduce(&localsqnorm, &m_globalsqnorm, 1, MPI_DOUBLE, MPI_SUM,
+                  MPI_COMM_WORLD);
+    m_input = input;
+  }
+
+  void clear() { m_input = NULL; }
+
+  /// whether the invariants below hold for the block input of size m x n
+  bool cached(const void *input, UWORD m, UWORD n) const {
+    return m_input != NULL && m_input == input && m_m == m && m_n == n;
+  }
+
+  double localnorm() const { return std::sqrt(m_localsqnorm); }
+  double globalsqnorm() const { return m_globalsqnorm; }
+  UWORD globalm() const { return m_globalm; }
+  UWORD globaln() const { return m_globaln; }
+};
+
+}  // namespace planc
+
+#endif  // DISTNMF_DISTINPUTCONTEXT_HPP_
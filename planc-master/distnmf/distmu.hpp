@@ -27,13 +27,20 @@ class DistMU : public DistAUNMF<INPUTMATTYPE> {
    * this->HtH is of size kxk
    * \f$w_{ij} = w_{ij} .* \frac{(AH)_{ij}}{(WH^TH)_{ij}}\f$
    * Here ij is the element of W matrix.
+   * Repeated while HtH and AHtij stay fixed, see innerConverged.
    */
   void updateW() {
-    WHtH = (this->W * this->HtH) + EPSILON;
+    double first = 0;
+    for (unsigned int sweep = 0;; sweep++) {
+      WHtH = (this->W * this->HtH) + EPSILON;
 #ifdef MPI_VERBOSE
-    DISTPRINTINFO("::WHtH::" << endl << this->WHtH);
+      DISTPRINTINFO("::WHtH::" << endl << this->WHtH);
 #endif  // ifdef MPI_VERBOSE
-    this->W = (this->W % this->AHtij.t()) / WHtH;
+      WHtH = (this->W % this->AHtij.t()) / WHtH;
+      double change = arma::accu(arma::square(WHtH - this->W));
+      this->W = WHtH;
+      if (this->innerConverged(sweep, change, &first)) break;
+    }
     DISTPRINTINFO("MU::updateW::HtH::"
                   << PRINTMATINFO(this->HtH) << "::WHtH::" << PRINTMATINFO(WHtH)
                   << "::AHtij::" << PRINTMATINFO(this->AHtij)
@@ -65,13 +72,20 @@ class DistMU : public DistAUNMF<INPUTMATTYPE> {
    * this->WtW is of size kxk
    * \f$h_{ij} = \frac{h_{ij} .* WtAij.t()}{(HW^TW)_{ij}}\f$
    * Here ij is the element of H matrix.
+   * Repeated while WtW and WtAij stay fixed, see innerConverged.
    */  
   void updateH() {
-    HWtW = this->H * this->WtW + EPSILON;
-    this->H = (this->H % this->WtAij.t()) / HWtW;
+    double first = 0;
+    for (unsigned int sweep = 0;; sweep++) {
+      HWtW = this->H * this->WtW + EPSILON;
 #ifdef MPI_VERBOSE
-    DISTPRINTINFO("::HWtW::" << endl << HWtW);
+      DISTPRINTINFO("::HWtW::" << endl << HWtW);
 #endif  // ifdef MPI_VERBOSE
+      HWtW = (this->H % this->WtAij.t()) / HWtW;
+      double change = arma::accu(arma::square(HWtW - this->H));
+      this->H = HWtW;
+      if (this->innerConverged(sweep, change, &first)) break;
+    }
 
     // fixNumericalError<MAT>(&this->H);
     DISTPRINTINFO("MU::updateH::WtW::"
@@ -3,8 +3,12 @@
 #ifndef DISTNMF_DISTNMF_HPP_
 #define DISTNMF_DISTNMF_HPP_
 
+#include <cstdio>
 #include <string>
+#include <vector>
 #include "common/nmf.hpp"
+#include "distnmf/distinputcontext.hpp"
+#include "distnmf/distreduce.hpp"
 #include "distnmf/mpicomm.hpp"
 #include "distnmftime.hpp"
 #ifdef USE_PACOSS
@@ -30,6 +34,22 @@ class DistNMF : public NMF<INPUTMATTYPE> {
   algotype m_algorithm;
   ROWVEC localWnorm;
   ROWVEC Wnorm;
+  /// small sums that are ready at the same point share one allreduce
+  DistReduce m_reducer;
+
+ private:
+  // timings queued by reportTime until flushReportedTimes
+  std::vector<double> m_reported_times;
+  std::vector<std::string> m_reported_names;
+  std::string m_trace_file;  /// per iteration csv of reportTrace
+
+  /// norm of input from the input context, one pass over input otherwise
+  static double localNorm(const INPUTMATTYPE &input) {
+    const DistInputContext &context = DistInputContext::instance();
+    if (context.cached(&input, input.n_rows, input.n_cols))
+      return context.localnorm();
+    return arma::norm(input, "fro");
+  }
 
  public:
   /**
@@ -42,14 +62,21 @@ class DistNMF : public NMF<INPUTMATTYPE> {
    */  
   DistNMF(const INPUTMATTYPE &input, const MAT &leftlowrankfactor,
           const MAT &rightlowrankfactor, const MPICommunicator &communicator)
-      : NMF<INPUTMATTYPE>(input, leftlowrankfactor, rightlowrankfactor),
+      : NMF<INPUTMATTYPE>(input, leftlowrankfactor, rightlowrankfactor,
+                          localNorm(input)),
         m_mpicomm(communicator),
         time_stats(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0) {
+    const DistInputContext &context = DistInputContext::instance();
+    bool cached = context.cached(&input, input.n_rows, input.n_cols);
     double sqnorma = this->normA * this->normA;
     this->m_globalm = 0;
     this->m_globaln = 0;
-    MPI_Allreduce(&sqnorma, &(this->m_globalsqnormA), 1, MPI_DOUBLE, MPI_SUM,
-                  MPI_COMM_WORLD);
+    if (cached) {
+      this->m_globalsqnormA = context.globalsqnorm();
+    } else {
+      MPI_Allreduce(&sqnorma, &(this->m_globalsqnormA), 1, MPI_DOUBLE,
+                    MPI_SUM, MPI_COMM_WORLD);
+    }
     this->m_ownedm = this->W.n_rows;
     this->m_ownedn = this->H.n_rows;
 #ifdef USE_PACOSS
@@ -57,10 +84,15 @@ class DistNMF : public NMF<INPUTMATTYPE> {
     this->m_globalm = this->W.n_rows * this->m_mpicomm.size();
     this->m_globaln = this->H.n_rows * this->m_mpicomm.size();
 #else
-    MPI_Allreduce(&(this->m), &(this->m_globalm), 1, MPI_INT, MPI_SUM,
-                  this->m_mpicomm.commSubs()[0]);
-    MPI_Allreduce(&(this->n), &(this->m_globaln), 1, MPI_INT, MPI_SUM,
-                  this->m_mpicomm.commSubs()[1]);
+    if (cached) {
+      this->m_globalm = context.globalm();
+      this->m_globaln = context.globaln();
+    } else {
+      MPI_Allreduce(&(this->m), &(this->m_globalm), 1, MPI_INT, MPI_SUM,
+                    this->m_mpicomm.commSubs()[0]);
+      MPI_Allreduce(&(this->n), &(this->m_globaln), 1, MPI_INT, MPI_SUM,
+                    this->m_mpicomm.commSubs()[1]);
+    }
 #endif
     if (ISROOT) {
       INFO << "globalsqnorma::" << this->m_globalsqnormA
@@ -92,19 +124,113 @@ class DistNMF : public NMF<INPUTMATTYPE> {
   const bool is_compute_error() const { return (this->m_compute_error); }
   /// returns the NMF algorithm
   void algorithm(algotype dat) { this->m_algorithm = dat; }
-  /// Reports the time
+  /**
+   * Reports the time. The min, avg and max over the ranks are not reduced
+   * here, which would synchronize the ranks inside the iterations, but
+   * queued and printed by flushReportedTimes.
+   */
   void reportTime(const double temp, const std::string &reportstring) {
-    double mintemp, maxtemp, sumtemp;
-    MPI_Allreduce(&temp, &maxtemp, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
-    MPI_Allreduce(&temp, &mintemp, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
-    MPI_Allreduce(&temp, &sumtemp, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
-    PRINTROOT(reportstring << "::m::" << this->m_globalm
-                           << "::n::" << this->m_globaln << "::k::" << this->k
-                           << "::SIZE::" << MPI_SIZE
-                           << "::algo::" << this->m_algorithm
-                           << "::root::" << temp << "::min::" << mintemp
-                           << "::avg::" << (sumtemp) / (MPI_SIZE)
-                           << "::max::" << maxtemp);
+    m_reported_times.push_back(temp);
+    m_reported_names.push_back(reportstring);
+  }
+  /**
+   * Reduces the min, max and sum of every queued time with one collective
+   * and prints them in the order they were reported. Every rank has to
+   * report the same sequence of times.
+   */
+  void flushReportedTimes() {
+    int n = m_reported_times.size();
+    std::vector<double> maxtemp(n), mintemp(n), sumtemp(n);
+    DistReduce::maxMinSum(m_reported_times.data(), n, maxtemp.data(),
+                          mintemp.data(), sumtemp.data(), MPI_COMM_WORLD);
+    for (int i = 0; i < n; i++) {
+      PRINTROOT(m_reported_names[i]
+                << "::m::" << this->m_globalm << "::n::" << this->m_globaln
+                << "::k::" << this->k << "::SIZE::" << MPI_SIZE
+                << "::algo::" << this->m_algorithm
+                << "::root::" << m_reported_times[i] << "::min::" << mintemp[i]
+                << "::avg::" << (sumtemp[i]) / (MPI_SIZE)
+                << "::max::" << maxtemp[i]);
+    }
+    m_reported_times.clear();
+    m_reported_names.clear();
+  }
+  /// Per iteration timings are also written to this csv by reportTrace
+  void trace_file(const std::string &file_name) { m_trace_file = file_name; }
+  /**
+   * Reduces the per iteration trace of time_stats with one collective.
+   * Root prints for every phase the min, avg and max over the ranks
+   * averaged over the iterations and the imbalance max/avg, and writes
+   * the values of every iteration to the trace file if one is set.
+   * The collective calls and bytes per rank and iteration and the achieved
+   * bandwidth, bytes over the time of the phase, are printed next to the
+   * times. words/iter is the sum over the phases and compares with the
+   * words/iter estimate of --autogrid. calls/iter does not compare with its
+   * msgs/iter, which counts the log p messages inside every collective.
+   */
+  void reportTrace() {
+    int iters = this->time_stats.trace_iterations();
+    int cols = DistNMFTime::trace_columns();
+    if (iters == 0) return;
+    std::vector<double> local = this->time_stats.trace_rows();
+    int rows = local.size();
+    for (int c = 0; c < cols; c++) {
+      local.push_back(this->time_stats.calls(c));
+      local.push_back(this->time_stats.bytes(c));
+      local.push_back(this->time_stats.phase_time(c));
+    }
+    int n = local.size();
+    std::vector<double> maxtemp(n), mintemp(n), sumtemp(n);
+    DistReduce::maxMinSum(local.data(), n, maxtemp.data(), mintemp.data(),
+                          sumtemp.data(), MPI_COMM_WORLD);
+    if (!(ISROOT)) return;
+    INFO << "trace::k::" << this->k << "::algo::" << this->m_algorithm
+         << "::iterations::" << iters << std::endl;
+    fprintf(stdout, "%-22s %12s %12s %12s %10s %8s %12s %10s\n", "phase",
+            "min", "avg", "max", "imbalance", "calls/it", "bytes/it", "GB/s");
+    double count = this->time_stats.trace_count();
+    double totalcalls = 0, totalbytes = 0;
+    for (int c = 0; c < cols; c++) {
+      double mn = 0, avg = 0, mx = 0;
+      for (int i = 0; i < iters; i++) {
+        mn += mintemp[i * cols + c];
+        avg += sumtemp[i * cols + c] / MPI_SIZE;
+        mx += maxtemp[i * cols + c];
+      }
+      double calls = sumtemp[rows + 3 * c] / MPI_SIZE / count;
+      double bytes = sumtemp[rows + 3 * c + 1] / MPI_SIZE / count;
+      double secs = sumtemp[rows + 3 * c + 2] / MPI_SIZE / count;
+      totalcalls += calls;
+      totalbytes += bytes;
+      if (mx == 0) continue;
+      fprintf(stdout,
+              "%-22s %12.4e %12.4e %12.4e %10.3f %8.1f %12.4e %10.3f\n",
+              DistNMFTime::trace_name(c).c_str(), mn / iters, avg / iters,
+              mx / iters, avg > 0 ? mx / avg : 1.0, calls, bytes,
+              secs > 0 ? bytes / secs / 1e9 : 0.0);
+    }
+    fflush(stdout);
+    INFO << "trace::comm::words/iter::" << totalbytes / 8
+         << "::calls/iter::" << totalcalls << std::endl;
+    if (m_trace_file.empty()) return;
+    FILE *fp = fopen(m_trace_file.c_str(), "w");
+    if (fp == NULL) {
+      WARN << "could not open the trace file " << m_trace_file << std::endl;
+      return;
+    }
+    fprintf(fp, "iter,phase,min,avg,max,imbalance\n");
+    for (int i = 0; i < iters; i++) {
+      for (int c = 0; c < cols; c++) {
+        double avg = sumtemp[i * cols + c] / MPI_SIZE;
+        double mx = maxtemp[i * cols + c];
+        if (mx == 0) continue;
+        fprintf(fp, "%d,%s,%.9e,%.9e,%.9e,%.6f\n",
+                this->time_stats.trace_first() + i,
+                DistNMFTime::trace_name(c).c_str(), mintemp[i * cols + c],
+                avg, mx, avg > 0 ? mx / avg : 1.0);
+      }
+    }
+    fclose(fp);
   }
   /// Column Normalizes the distributed W matrix
   void normalize_by_W() {
@@ -112,8 +238,8 @@ class DistNMF : public NMF<INPUTMATTYPE> {
     mpitic();
     MPI_Allreduce(localWnorm.memptr(), Wnorm.memptr(), this->k, MPI_DOUBLE,
                   MPI_SUM, MPI_COMM_WORLD);
-    double temp = mpitoc();
-    this->time_stats.allgather_duration(temp);
+    double temp = mpitoc("normalize::allreduce", 8.0 * this->k);
+    this->time_stats.allreduce_duration(temp, 8.0 * this->k);
     for (int i = 0; i < this->k; i++) {
       if (Wnorm(i) > 1) {
         double norm_const = sqrt(Wnorm(i));
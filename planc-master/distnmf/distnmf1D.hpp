@@ -7,6 +7,7 @@
 #include "common/distutils.hpp"
 #include "common/utils.h"
 #include "common/utils.hpp"
+#include "distnmf/distreduce.hpp"
 
 namespace planc {
 
@@ -174,9 +175,8 @@ class DistNMF1D {
   void algorithm(algotype dat) { this->m_algorithm = dat; }
   void reportTime(const double temp, const std::string &reportstring) {
     double mintemp, maxtemp, sumtemp;
-    MPI_Allreduce(&temp, &maxtemp, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
-    MPI_Allreduce(&temp, &mintemp, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
-    MPI_Allreduce(&temp, &sumtemp, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+    DistReduce::maxMinSum(&temp, 1, &maxtemp, &mintemp, &sumtemp,
+                          MPI_COMM_WORLD);
     PRINTROOT(reportstring << "::m::" << this->m_globalm
                            << "::n::" << this->m_globaln << "::k::" << this->m_k
                            << "::SIZE::" << MPI_SIZE
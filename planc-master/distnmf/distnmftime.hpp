@@ -3,12 +3,30 @@
 #ifndef DISTNMF_DISTNMFTIME_HPP_
 #define DISTNMF_DISTNMFTIME_HPP_
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 /**
  * Class and function for collecting time statistics 
  */
 
 namespace planc {
 
+/// phases of the per iteration trace of DistNMFTime
+enum tracephase {
+  TRACE_GRAM,
+  TRACE_MM,
+  TRACE_NNLS,
+  TRACE_ALLGATHER,
+  TRACE_REDUCESCATTER,
+  TRACE_ALLREDUCE,
+  TRACE_SENDRECV,
+  TRACE_ERR_COMPUTE,
+  TRACE_ERR_COMMUNICATION,
+  TRACE_NUM_PHASES
+};
+
 class DistNMFTime {
  private:
   double m_duration;
@@ -27,6 +45,41 @@ class DistNMFTime {
   double m_gradient_duration;
   double m_cg_duration;
   double m_projection_duration;
+  double m_nnls_fallbacks = 0;  /// right hand sides BPP left to active set
+  double m_inner_sweeps = 0;    /// sweeps of HALS and MU, ADMM iterations
+
+  /**
+   * Ring buffer of the last kTraceCapacity iterations. Every row holds the
+   * phases of the update of H, those of the update of W and the iteration
+   * time. Nothing is communicated while recording.
+   */
+  static const int kTraceCapacity = 1024;
+  static const int kTraceSteps = 2;
+  static const int kTraceColumns = kTraceSteps * TRACE_NUM_PHASES + 1;
+  std::vector<double> m_trace;
+  int m_trace_iter = -1;   /// iteration being recorded, -1 when not tracing
+  int m_trace_step = 0;    /// 0 while updating H, 1 while updating W
+  int m_trace_first = 0;   /// first iteration still in the buffer
+  int m_trace_last = -1;   /// last recorded iteration
+  int m_trace_count = 0;   /// iterations recorded, including overwritten
+
+  // totals of every trace column over all the iterations. The collectives
+  // count one call of this rank with the bytes it moved, not the log p
+  // messages of the tree or ring inside the call that DistGrid models.
+  double m_phase_time[kTraceColumns] = {};
+  double m_calls[kTraceColumns] = {};
+  double m_bytes[kTraceColumns] = {};
+
+  void trace(int phase, double d) {
+    m_phase_time[m_trace_step * TRACE_NUM_PHASES + phase] += d;
+    if (m_trace_iter < 0) return;
+    m_trace[(m_trace_iter % kTraceCapacity) * kTraceColumns +
+            m_trace_step * TRACE_NUM_PHASES + phase] += d;
+  }
+  void count(int phase, double bytes) {
+    m_calls[m_trace_step * TRACE_NUM_PHASES + phase] += 1;
+    m_bytes[m_trace_step * TRACE_NUM_PHASES + phase] += bytes;
+  }
 
  public:
   DistNMFTime(double d, double compute_d, double communication_d,
@@ -101,25 +154,158 @@ class DistNMFTime {
   const double gradient_duration() const { return m_gradient_duration; }
   const double cg_duration() const { return m_cg_duration; }
   const double projection_duration() const { return m_projection_duration; }
+  const double nnls_fallbacks() const { return m_nnls_fallbacks; }
+  const double inner_sweeps() const { return m_inner_sweeps; }
   // Update Functions
-  void duration(double d) { m_duration += d; }
+  void duration(double d) {
+    m_duration += d;
+    if (m_trace_iter >= 0)
+      m_trace[(m_trace_iter % kTraceCapacity + 1) * kTraceColumns - 1] += d;
+  }
   void compute_duration(double d) { m_compute_duration += d; }
   void communication_duration(double d) { m_communication_duration += d; }
-  void allgather_duration(double d) { m_allgather_duration += d; }
-  void allreduce_duration(double d) { m_allreduce_duration += d; }
-  void reducescatter_duration(double d) { m_reducescatter_duration += d; }
-  void sendrecv_duration(double d) { m_sendrecv_duration += d; }
-  void gram_duration(double d) { m_gram_duration += d; }
+  void allgather_duration(double d) {
+    m_allgather_duration += d;
+    trace(TRACE_ALLGATHER, d);
+  }
+  void allreduce_duration(double d) {
+    m_allreduce_duration += d;
+    trace(TRACE_ALLREDUCE, d);
+  }
+  void reducescatter_duration(double d) {
+    m_reducescatter_duration += d;
+    trace(TRACE_REDUCESCATTER, d);
+  }
+  void sendrecv_duration(double d) {
+    m_sendrecv_duration += d;
+    trace(TRACE_SENDRECV, d);
+  }
+  void gram_duration(double d) {
+    m_gram_duration += d;
+    trace(TRACE_GRAM, d);
+  }
   void nongram_duration(double d) { m_nongram_duration += d; }
-  void mm_duration(double d) { m_mm_duration += d; }
-  void nnls_duration(double d) { m_nnls_duration += d; }
-  void err_compute_duration(double d) { m_err_compute_duration += d; }
+  void mm_duration(double d) {
+    m_mm_duration += d;
+    trace(TRACE_MM, d);
+  }
+  void nnls_duration(double d) {
+    m_nnls_duration += d;
+    trace(TRACE_NNLS, d);
+  }
+  void err_compute_duration(double d) {
+    m_err_compute_duration += d;
+    trace(TRACE_ERR_COMPUTE, d);
+  }
   void err_communication_duration(double d) {
     m_err_communication_duration += d;
+    trace(TRACE_ERR_COMMUNICATION, d);
+  }
+  // Update Functions that also count one call of the given bytes
+  void allgather_duration(double d, double bytes) {
+    allgather_duration(d);
+    count(TRACE_ALLGATHER, bytes);
+  }
+  void allreduce_duration(double d, double bytes) {
+    allreduce_duration(d);
+    count(TRACE_ALLREDUCE, bytes);
+  }
+  void reducescatter_duration(double d, double bytes) {
+    reducescatter_duration(d);
+    count(TRACE_REDUCESCATTER, bytes);
+  }
+  void sendrecv_duration(double d, double bytes) {
+    sendrecv_duration(d);
+    count(TRACE_SENDRECV, bytes);
+  }
+  void err_communication_duration(double d, double bytes) {
+    err_communication_duration(d);
+    count(TRACE_ERR_COMMUNICATION, bytes);
   }
   void gradient_duration(double d) { m_gradient_duration += d; }
   void cg_duration(double d) { m_cg_duration += d; }
   void projection_duration(double d) { m_projection_duration += d; }
+  void nnls_fallbacks(double n) { m_nnls_fallbacks += n; }
+  void inner_sweeps(double n) { m_inner_sweeps += n; }
+
+  // Trace Functions
+  /**
+   * Starts recording iteration iter and the update of H. Iterations have
+   * to be recorded in increasing order, older ones are overwritten after
+   * kTraceCapacity iterations.
+   */
+  void trace_iteration(int iter) {
+    if (m_trace.empty()) {
+      m_trace.resize(kTraceCapacity * kTraceColumns);
+      m_trace_first = iter;
+    }
+    m_trace_iter = iter;
+    m_trace_last = iter;
+    m_trace_count++;
+    m_trace_step = 0;
+    if (iter - m_trace_first >= kTraceCapacity)
+      m_trace_first = iter - kTraceCapacity + 1;
+    std::fill(m_trace.begin() + (iter % kTraceCapacity) * kTraceColumns,
+              m_trace.begin() + (iter % kTraceCapacity + 1) * kTraceColumns,
+              0.0);
+  }
+  /// The following times belong to the update of W
+  void trace_update_W() { m_trace_step = 1; }
+  /// Stops recording. The recorded iterations are kept.
+  void trace_stop() { m_trace_iter = -1; }
+  /// Number of iterations in the trace
+  int trace_iterations() const {
+    return m_trace_last < 0 ? 0 : m_trace_last - m_trace_first + 1;
+  }
+  /// First iteration in the trace
+  int trace_first() const { return m_trace_first; }
+  /**
+   * Copies the trace in the order of the iterations, one row of
+   * trace_columns() values per iteration.
+   */
+  std::vector<double> trace_rows() const {
+    std::vector<double> rows;
+    for (int it = m_trace_first; it <= m_trace_last; it++) {
+      int r = it % kTraceCapacity;
+      rows.insert(rows.end(), m_trace.begin() + r * kTraceColumns,
+                  m_trace.begin() + (r + 1) * kTraceColumns);
+    }
+    return rows;
+  }
+  static int trace_columns() { return kTraceColumns; }
+  /// Iterations recorded since the construction
+  int trace_count() const { return m_trace_count; }
+  /// Time, collective calls and bytes of a trace column over all iterations
+  double phase_time(int column) const {
+    return column < kTraceColumns - 1 ? m_phase_time[column] : m_duration;
+  }
+  double calls(int column) const {
+    return column < kTraceColumns - 1 ? m_calls[column] : 0;
+  }
+  double bytes(int column) const {
+    return column < kTraceColumns - 1 ? m_bytes[column] : 0;
+  }
+  /// Calls and bytes of all the collectives
+  double total_calls() const {
+    double total = 0;
+    for (int c = 0; c < kTraceColumns - 1; c++) total += m_calls[c];
+    return total;
+  }
+  double total_bytes() const {
+    double total = 0;
+    for (int c = 0; c < kTraceColumns - 1; c++) total += m_bytes[c];
+    return total;
+  }
+  /// Name of a column of the trace, e.g. H::mm for the WtA multiplies
+  static std::string trace_name(int column) {
+    static const char *phases[] = {
+        "gram",     "mm",          "nnls",
+        "allgather", "reducescatter", "allreduce",
+        "sendrecv", "err_compute", "err_communication"};
+    if (column == kTraceColumns - 1) return "iteration";
+    return std::string(column < TRACE_NUM_PHASES ? "H::" : "W::") +
+           phases[column % TRACE_NUM_PHASES];
+  }
 };
 
 }  // namespace planc
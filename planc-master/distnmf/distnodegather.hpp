@@ -0,0 +1,155 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file gathers a factor block once per node into an MPI-3 shared memory window.
+*/
+
+#ifndef DISTNMF_DISTNODEGATHER_HPP_
+#define DISTNMF_DISTNODEGATHER_HPP_
+
+#include <mpi.h>
+#include <cstring>
+#include <vector>
+#include "common/distutils.hpp"
+
+namespace planc {
+
+/**
+ * Hierarchical replacement of an MPI_Allgatherv over a grid communicator.
+ * The ranks of the communicator that share a node hold one copy of the
+ * gathered buffer in a shared memory window. Every rank copies its own
+ * block into the window and the node leaders exchange the blocks of their
+ * nodes with one MPI_Allgatherv, so the data crosses the network once per
+ * node instead of once per rank. The blocks of a node have to be contiguous
+ * in the gathered buffer, i.e. the node holds a contiguous range of ranks
+ * of the communicator. setup() leaves the gather inactive when that is not
+ * the case or when no node holds more than one rank.
+ * @tparam eT element type of the gathered buffer
+ */
+template <class eT>
+class DistNodeGather {
+ private:
+  bool m_active;
+  MPI_Comm m_nodecomm;    /// ranks of the grid communicator on this node
+  MPI_Comm m_leadercomm;  /// lowest rank of every node, NULL elsewhere
+  MPI_Win m_win;
+  eT *m_buf;              /// gathered buffer in the window of the leader
+  int m_disp;             /// offset of the local block in m_buf
+  double m_recvbytes;     /// bytes received by this rank per gather
+  int m_numnodes;         /// nodes holding ranks of the grid communicator
+  std::vector<int> m_nodecnts;  /// values of every node
+  std::vector<int> m_nodedisp;  /// offset of every node
+
+  void sync() {
+    MPI_Win_sync(m_win);
+    MPI_Barrier(m_nodecomm);
+    MPI_Win_sync(m_win);
+  }
+
+ public:
+  DistNodeGather()
+      : m_active(false), m_nodecomm(MPI_COMM_NULL),
+        m_leadercomm(MPI_COMM_NULL), m_win(MPI_WIN_NULL), m_buf(NULL),
+        m_disp(0), m_recvbytes(0), m_numnodes(1) {}
+  ~DistNodeGather() { free(); }
+
+  /**
+   * Splits comm by node and allocates the shared buffer. Collective over
+   * comm, the result is the same on all its ranks.
+   * @param[in] comm communicator of the replaced MPI_Allgatherv
+   * @param[in] cnts, disp receive counts and displacements of that call
+   * @return whether the gather is active
+   */
+  bool setup(MPI_Comm comm, const std::vector<int> &cnts,
+             const std::vector<int> &disp) {
+    free();
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL,
+                        &m_nodecomm);
+    int noderank, nodesize;
+    MPI_Comm_rank(m_nodecomm, &noderank);
+    MPI_Comm_size(m_nodecomm, &nodesize);
+    std::vector<int> members(nodesize);
+    MPI_Allgather(&rank, 1, MPI_INT, &members[0], 1, MPI_INT, m_nodecomm);
+    // [contiguous, -nodesize] reduced with MIN in one call
+    int local[2] = {1, -nodesize}, global[2];
+    for (int i = 1; i < nodesize; i++)
+      if (members[i] != members[0] + i) local[0] = 0;
+    MPI_Allreduce(local, global, 2, MPI_INT, MPI_MIN, comm);
+    if (global[0] == 0 || -global[1] == 1) {
+      MPI_Comm_free(&m_nodecomm);
+      return false;
+    }
+    MPI_Comm_split(comm, noderank == 0 ? 0 : MPI_UNDEFINED, rank,
+                   &m_leadercomm);
+    int total = 0;
+    for (int i = 0; i < size; i++) total += cnts[i];
+    int nodecnt = 0;
+    for (int i = 0; i < nodesize; i++) nodecnt += cnts[members[i]];
+    m_recvbytes = 0;
+    if (m_leadercomm != MPI_COMM_NULL) {
+      MPI_Comm_size(m_leadercomm, &m_numnodes);
+      m_nodecnts.resize(m_numnodes);
+      m_nodedisp.resize(m_numnodes);
+      MPI_Allgather(&nodecnt, 1, MPI_INT, &m_nodecnts[0], 1, MPI_INT,
+                    m_leadercomm);
+      MPI_Allgather(&disp[members[0]], 1, MPI_INT, &m_nodedisp[0], 1,
+                    MPI_INT, m_leadercomm);
+      m_recvbytes = static_cast<double>(sizeof(eT)) * (total - nodecnt);
+    }
+    MPI_Bcast(&m_numnodes, 1, MPI_INT, 0, m_nodecomm);
+    MPI_Aint winsize = noderank == 0 ? total * sizeof(eT) : 0;
+    eT *base;
+    MPI_Win_allocate_shared(winsize, sizeof(eT), MPI_INFO_NULL,
+                            m_nodecomm, &base, &m_win);
+    MPI_Aint leadersize;
+    int dispunit;
+    MPI_Win_shared_query(m_win, 0, &leadersize, &dispunit, &m_buf);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, m_win);
+    m_disp = disp[rank];
+    m_active = true;
+    return true;
+  }
+
+  /// Releases the window and the communicators. Collective.
+  void free() {
+    if (!m_active) return;
+    MPI_Win_unlock_all(m_win);
+    MPI_Win_free(&m_win);
+    if (m_leadercomm != MPI_COMM_NULL) MPI_Comm_free(&m_leadercomm);
+    MPI_Comm_free(&m_nodecomm);
+    m_buf = NULL;
+    m_active = false;
+  }
+
+  /**
+   * Gathers sendcnt values of every rank into memptr(). The previous
+   * contents may be overwritten only once every rank of the node is done
+   * reading them, hence the barrier in front.
+   */
+  void gather(const eT *sendbuf, int sendcnt) {
+    sync();
+    memcpy(m_buf + m_disp, sendbuf, sendcnt * sizeof(eT));
+    sync();
+    if (m_numnodes > 1) {
+      if (m_leadercomm != MPI_COMM_NULL)
+        MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, m_buf,
+                       &m_nodecnts[0], &m_nodedisp[0], mpitype<eT>(),
+                       m_leadercomm);
+      sync();
+    }
+  }
+
+  bool active() const { return m_active; }
+  /// gathered buffer shared by the ranks of the node
+  eT *memptr() const { return m_buf; }
+  /// bytes a rank receives over the network per gather
+  double recvbytes() const { return m_recvbytes; }
+};
+
+}  // namespace planc
+
+#endif  // DISTNMF_DISTNODEGATHER_HPP_
@@ -0,0 +1,107 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file packs small independent reductions into a single collective.
+*/
+
+#ifndef DISTNMF_DISTREDUCE_HPP_
+#define DISTNMF_DISTREDUCE_HPP_
+
+#include <mpi.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace planc {
+
+/**
+ * Aggregates MPI_SUM reductions that become ready at the same point of an
+ * iteration. Every add() appends the local values to one send buffer and
+ * allreduce() reduces all of them with a single MPI_Allreduce and copies
+ * the results back to their destinations. For small k the reductions are
+ * latency bound, so one message of 2k^2 values costs about as much as one
+ * of k^2 values.
+ */
+class DistReduce {
+ private:
+  std::vector<double> m_sendbuf;
+  std::vector<double> m_recvbuf;
+  std::vector<double *> m_dest;  /// destination of every queued block
+  std::vector<int> m_count;      /// length of every queued block
+
+  /// element wise max, min and sum of (max, min, sum) triples
+  static void maxMinSumOp(void *in, void *inout, int *len,
+                          MPI_Datatype *) {
+    double *a = static_cast<double *>(in);
+    double *b = static_cast<double *>(inout);
+    for (int i = 0; i < *len; i++, a += 3, b += 3) {
+      b[0] = std::max(a[0], b[0]);
+      b[1] = std::min(a[1], b[1]);
+      b[2] += a[2];
+    }
+  }
+
+ public:
+  /**
+   * Queues n local values to be summed over the communicator of the next
+   * allreduce() into out. in is copied, out must stay valid until then.
+   */
+  void add(const double *in, double *out, int n) {
+    m_sendbuf.insert(m_sendbuf.end(), in, in + n);
+    m_dest.push_back(out);
+    m_count.push_back(n);
+  }
+
+  /// Number of values queued since the last allreduce()
+  int size() const { return static_cast<int>(m_sendbuf.size()); }
+
+  /// Sums everything queued over comm with one MPI_Allreduce.
+  void allreduce(MPI_Comm comm) {
+    if (m_sendbuf.empty()) return;
+    m_recvbuf.resize(m_sendbuf.size());
+    MPI_Allreduce(&m_sendbuf[0], &m_recvbuf[0], size(), MPI_DOUBLE, MPI_SUM,
+                  comm);
+    const double *src = &m_recvbuf[0];
+    for (size_t i = 0; i < m_dest.size(); i++) {
+      memcpy(m_dest[i], src, m_count[i] * sizeof(double));
+      src += m_count[i];
+    }
+    m_sendbuf.clear();
+    m_dest.clear();
+    m_count.clear();
+  }
+
+  /**
+   * Max, min and sum of n values over comm in one collective. The three
+   * statistics of a value travel as one element of a contiguous datatype
+   * so that the reduction is never split inside a triple.
+   * @param[in] in n local values
+   * @param[out] max, min, sum n reduced values each
+   */
+  static void maxMinSum(const double *in, int n, double *max, double *min,
+                        double *sum, MPI_Comm comm) {
+    static MPI_Datatype triple = MPI_DATATYPE_NULL;
+    static MPI_Op op = MPI_OP_NULL;
+    if (n == 0) return;
+    if (op == MPI_OP_NULL) {
+      MPI_Type_contiguous(3, MPI_DOUBLE, &triple);
+      MPI_Type_commit(&triple);
+      MPI_Op_create(&maxMinSumOp, 1, &op);
+    }
+    std::vector<double> local(3 * n), global(3 * n);
+    for (int i = 0; i < n; i++) {
+      local[3 * i] = local[3 * i + 1] = local[3 * i + 2] = in[i];
+    }
+    MPI_Allreduce(&local[0], &global[0], n, triple, op, comm);
+    for (int i = 0; i < n; i++) {
+      max[i] = global[3 * i];
+      min[i] = global[3 * i + 1];
+      sum[i] = global[3 * i + 2];
+    }
+  }
+};
+
+}  // namespace planc
+
+#endif  // DISTNMF_DISTREDUCE_HPP_
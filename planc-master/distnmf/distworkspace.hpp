@@ -0,0 +1,82 @@
+/* Copyright 2020 Gopinath Chennupati, Raviteja Vangara, Namita Kharat, Erik Skau and Boian Alexandrov,
+Triad National Security, LLC. All rights reserved
+This program was produced under U.S. Government contract 89233218CNA000001 for Los Alamos National Laboratory (LANL), which is operated by Triad National Security, LLC for the U.S. Department of Energy/National Nuclear Security Administration. All rights in the program are reserved by Triad National Security, LLC, and the U.S. Department of Energy/National Nuclear Security Administration. The Government is granted for itself and others acting on its behalf a nonexclusive, paid-up, irrevocable worldwide license in this material to reproduce, prepare derivative works, distribute copies to the public, perform publicly and display publicly, and to permit others to do so.
+
+This file keeps the large buffers of the NMF multiplies alive across runs.
+*/
+
+#ifndef DISTNMF_DISTWORKSPACE_HPP_
+#define DISTNMF_DISTWORKSPACE_HPP_
+
+#include <armadillo>
+#include <deque>
+#include "common/utils.h"
+
+namespace planc {
+
+/**
+ * Process wide arena of numbered buffers. The driver reserves the slots
+ * for the largest k of the sweep once, and every NMF object borrows them
+ * as matrices of the current k instead of allocating and zeroing its own.
+ * A borrowed matrix aliases the slot memory, so the buffers are neither
+ * freed nor zeroed between runs. Only one object may hold the buffers at
+ * a time, acquire() fails while they are lent out and the object then
+ * allocates privately, as it does for a buffer no slot was reserved for.
+ * @tparam eT element type of the buffers
+ */
+template <class eT>
+class DistNMFWorkspace {
+ private:
+  std::deque<arma::Col<eT> > m_slots;  /// deque keeps the slots in place
+  bool m_enabled;
+  bool m_inuse;
+
+  DistNMFWorkspace() : m_enabled(false), m_inuse(false) {}
+
+ public:
+  static DistNMFWorkspace &instance() {
+    static DistNMFWorkspace workspace;
+    return workspace;
+  }
+
+  /// Grows slot i to at least n elements and enables the workspace.
+  void reserve(size_t i, UWORD n) {
+    while (m_slots.size() <= i) m_slots.push_back(arma::Col<eT>());
+    if (m_slots[i].n_elem < n) m_slots[i].set_size(n);
+    m_enabled = true;
+  }
+
+  /// Claims the buffers for one NMF object. false if unavailable.
+  bool acquire() {
+    if (!m_enabled || m_inuse) return false;
+    m_inuse = true;
+    return true;
+  }
+  void release() { m_inuse = false; }
+
+  /**
+   * Turns X into an r x c view of slot i. The view does not own the memory
+   * and its contents are whatever the previous borrower left there.
+   * Assigning a result of another size to X gives X private memory again.
+   * Slots only grow in reserve(), so the footprint stays what was reserved.
+   * @return false if slot i holds less than r x c elements
+   */
+  bool bind(size_t i, UWORD r, UWORD c, arma::Mat<eT> *X) {
+    if (i >= m_slots.size() || m_slots[i].n_elem < r * c) return false;
+    arma::Mat<eT> view(m_slots[i].memptr(), r, c, false, false);
+    X->steal_mem(view);
+    return true;
+  }
+
+  /// bytes held by all the slots
+  double bytes() const {
+    double total = 0;
+    for (size_t i = 0; i < m_slots.size(); i++)
+      total += sizeof(eT) * m_slots[i].n_elem;
+    return total;
+  }
+};
+
+}  // namespace planc
+
+#endif  // DISTNMF_DISTWORKSPACE_HPP_
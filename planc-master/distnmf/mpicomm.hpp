@@ -65,11 +65,16 @@ class MPICommunicator {
 #endif
   }
   MPICommunicator(int argc, char *argv[], int pr, int pc) {
+    // the grid may have been chosen after an early MPI_Init
+    int initialized;
+    MPI_Initialized(&initialized);
+    if (!initialized) {
 #ifdef USE_PACOSS
-    TMPI_Init(&argc, &argv);
+      TMPI_Init(&argc, &argv);
 #else
-    MPI_Init(&argc, &argv);
+      MPI_Init(&argc, &argv);
 #endif
+    }
     MPI_Comm_rank(MPI_COMM_WORLD, &m_rank);
     MPI_Comm_size(MPI_COMM_WORLD, &m_numProcs);
     int reorder = 0;